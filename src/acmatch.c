@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Multiple literal matching (Aho-Corasick): a text is scanned once,
+ * whatever the number of literals, and every literal occurring in it is
+ * reported.  The drive database uses it to only try the regular
+ * expressions whose literal part appears in a model name.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Application specific includes
+#include "acmatch.h"
+
+static int ac_child(const struct acmatch *ac, int node, int c) {
+  int n;
+
+  for(n = ac->nodes[node].child; n != -1; n = ac->nodes[n].sibling)
+    if(ac->nodes[n].c == c)
+      return n;
+
+  return -1;
+}
+
+static int ac_new_node(struct acmatch *ac, int c) {
+  struct ac_node *n;
+
+  if(ac->nnodes == ac->size) {
+    ac->size = ac->size ? 2 * ac->size : 64;
+    ac->nodes = (struct ac_node *) realloc(ac->nodes, ac->size * sizeof(struct ac_node));
+    if(ac->nodes == NULL) {
+      perror("realloc");
+      exit(-1);
+    }
+  }
+
+  n = &ac->nodes[ac->nnodes];
+  n->child = n->sibling = n->dict = n->out = -1;
+  n->fail = 0;
+  n->c = c;
+
+  return ac->nnodes++;
+}
+
+/* Ids go from 0 to nids - 1. */
+void ac_init(struct acmatch *ac, int nids) {
+  int i;
+
+  memset(ac, 0, sizeof(*ac));
+  ac->nids = nids;
+  ac->out_next = (int32_t *) malloc((nids ? nids : 1) * sizeof(int32_t));
+  if(ac->out_next == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  for(i = 0; i < nids; i++)
+    ac->out_next[i] = -1;
+
+  ac_new_node(ac, 0);
+}
+
+void ac_add(struct acmatch *ac, const char *literal, int len, int id) {
+  int node = 0, next, i;
+
+  for(i = 0; i < len; i++) {
+    int c = (unsigned char) literal[i];
+
+    if((next = ac_child(ac, node, c)) == -1) {
+      next = ac_new_node(ac, c);
+      ac->nodes[next].sibling = ac->nodes[node].child;
+      ac->nodes[node].child = next;
+    }
+    node = next;
+  }
+
+  ac->out_next[id] = ac->nodes[node].out;
+  ac->nodes[node].out = id;
+}
+
+/* Set the failure links, breadth first. */
+void ac_build(struct acmatch *ac) {
+  int32_t * queue;
+  int       head = 0, tail = 0;
+  int       n, u, f, v;
+
+  queue = (int32_t *) malloc(ac->nnodes * sizeof(int32_t));
+  if(queue == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  for(n = ac->nodes[0].child; n != -1; n = ac->nodes[n].sibling) {
+    ac->nodes[n].fail = 0;
+    queue[tail++] = n;
+  }
+
+  while(head < tail) {
+    u = queue[head++];
+
+    for(v = ac->nodes[u].child; v != -1; v = ac->nodes[v].sibling) {
+      int c = ac->nodes[v].c;
+
+      for(f = ac->nodes[u].fail; f != 0 && ac_child(ac, f, c) == -1; f = ac->nodes[f].fail)
+        ;
+      f = ac_child(ac, f, c);
+      ac->nodes[v].fail = (f == -1 || f == v) ? 0 : f;
+
+      f = ac->nodes[v].fail;
+      ac->nodes[v].dict = ac->nodes[f].out != -1 ? f : ac->nodes[f].dict;
+
+      queue[tail++] = v;
+    }
+  }
+
+  free(queue);
+}
+
+/* Call found(id, arg) for each literal occurring in text, once per
+   occurrence. */
+void ac_scan(const struct acmatch *ac, const char *text, void (*found)(int, void *), void *arg) {
+  int node = 0, next, o, id;
+
+  if(ac->nnodes == 0)
+    return;
+
+  for(; *text; text++) {
+    int c = (unsigned char) *text;
+
+    while((next = ac_child(ac, node, c)) == -1 && node != 0)
+      node = ac->nodes[node].fail;
+    node = (next == -1) ? 0 : next;
+
+    o = ac->nodes[node].out != -1 ? node : ac->nodes[node].dict;
+    for(; o != -1; o = ac->nodes[o].dict)
+      for(id = ac->nodes[o].out; id != -1; id = ac->out_next[id])
+        found(id, arg);
+  }
+}
+
+/* Whether an automaton read from outside has the shape ac_build()
+   gives it, so that scanning it ends: the children lists form a tree
+   holding every node once, fail and dict links lead to shallower nodes
+   and every id is on a single out list.  The links are already known
+   to be in range.  Returns 0 if so, -1 if not. */
+int ac_check(const struct acmatch *ac) {
+  int32_t *       depth;
+  int32_t *       queue;
+  unsigned char * seen;
+  int             head = 0, tail = 0, ret = -1;
+  int             n, u, v, id;
+
+  if(ac->nnodes <= 0)
+    return -1;
+
+  depth = (int32_t *) malloc(ac->nnodes * sizeof(int32_t));
+  queue = (int32_t *) malloc(ac->nnodes * sizeof(int32_t));
+  seen = (unsigned char *) calloc(ac->nids ? ac->nids : 1, 1);
+  if(depth == NULL || queue == NULL || seen == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  for(n = 0; n < ac->nnodes; n++)
+    depth[n] = -1;
+
+  depth[0] = 0;
+  queue[tail++] = 0;
+  while(head < tail) {
+    u = queue[head++];
+    for(v = ac->nodes[u].child; v != -1; v = ac->nodes[v].sibling) {
+      if(depth[v] != -1)
+        goto out;
+      depth[v] = depth[u] + 1;
+      queue[tail++] = v;
+    }
+  }
+  if(tail != ac->nnodes)
+    goto out;
+
+  for(n = 0; n < ac->nnodes; n++) {
+    const struct ac_node *node = &ac->nodes[n];
+
+    if(n != 0 && depth[node->fail] >= depth[n])
+      goto out;
+    if(node->dict != -1 && (depth[node->dict] >= depth[n] || ac->nodes[node->dict].out == -1))
+      goto out;
+
+    for(id = node->out; id != -1; id = ac->out_next[id]) {
+      if(seen[id])
+        goto out;
+      seen[id] = 1;
+    }
+  }
+  ret = 0;
+
+ out:
+  free(seen);
+  free(queue);
+  free(depth);
+  return ret;
+}
+
+void ac_free(struct acmatch *ac) {
+  free(ac->nodes);
+  free(ac->out_next);
+  memset(ac, 0, sizeof(*ac));
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __ACMATCH_H__
+#define __ACMATCH_H__
+
+#include <stdint.h>
+
+/* Aho-Corasick automaton over a set of literals, each tagged with an id.
+   The trie is kept as flat arrays (children as sibling lists) so that it
+   can be written out and used in place. */
+struct ac_node {
+  int32_t         child;          /* first child, or -1 */
+  int32_t         sibling;        /* next child of the parent, or -1 */
+  int32_t         fail;           /* longest proper suffix in the trie */
+  int32_t         dict;           /* nearest node on the fail chain with ids, or -1 */
+  int32_t         out;            /* first id ending here, or -1 */
+  int32_t         c;
+};
+
+struct acmatch {
+  struct ac_node *  nodes;
+  int32_t *         out_next;     /* per id, next id ending at the same node */
+  int32_t           nnodes;
+  int32_t           nids;
+  int32_t           size;         /* allocated nodes */
+};
+
+void ac_init(struct acmatch *ac, int nids);
+void ac_add(struct acmatch *ac, const char *literal, int len, int id);
+void ac_build(struct acmatch *ac);
+void ac_scan(const struct acmatch *ac, const char *text, void (*found)(int, void *), void *arg);
+int ac_check(const struct acmatch *ac);
+void ac_free(struct acmatch *ac);
+
+#endif
@@ -52,9 +52,11 @@
                 (((u16)(__x) & (u16)0xff00U) >> 8) )); \
 })
 
-static char sbuff[SBUFF_SIZE];
-
+/* probes run from several threads, so the identify data is kept on
+   the stack */
 static int ata_probe(int device) {
+  char sbuff[SBUFF_SIZE];
+
   if(device == -1 || ioctl(device, HDIO_GET_IDENTITY, sbuff))
     return 0;
   else
@@ -62,10 +64,12 @@ static int ata_probe(int device) {
 }
 
 static const char *ata_model (int device) {
+  char sbuff[SBUFF_SIZE];
+
   if(device == -1 || ioctl(device, HDIO_GET_IDENTITY, sbuff))
     return strdup(_("unknown"));
   else
-    return strdup((char*) ((u16*)sbuff + 27));
+    return strndup((char*) ((u16*)sbuff + 27), 40);
 }
 
 
@@ -81,24 +85,22 @@ static enum e_gettemp ata_get_temperature(struct disk *dsk) {
     return GETTEMP_NOSENSOR;
   }
 
-  if(ata_get_packet(dsk->fd)) {
+  if(!(dsk->caps & CAP_SMART) && ata_get_packet(dsk->fd)) {
     snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("S.M.A.R.T. not available"));
     return GETTEMP_NOT_APPLICABLE;
   }
 
-  switch(ata_get_powermode(dsk->fd)) {
-  case PWM_STANDBY:
-  case PWM_SLEEPING:
-    if (!wakeup)
+  /* the drive is read anyway with --wake-up */
+  if(ata_check_powermode(dsk)) {
+    enum e_powermode state = ata_get_powermode(dsk->fd);
+
+    ata_powermode_result(dsk, state);
+    if(state == PWM_STANDBY || state == PWM_SLEEPING)
       return GETTEMP_DRIVE_SLEEP;
-  case PWM_UNKNOWN:
-  case PWM_ACTIVE: /* active or idle */
-  default:
-    break;
   }
 
-  /* get SMART values */
-  if(ata_enable_smart(dsk->fd) != 0) {
+  /* get SMART values, enabling them once */
+  if(!(dsk->caps & CAP_SMART) && ata_enable_smart(dsk->fd) != 0) {
     enum e_gettemp ret;
     if(errno == EIO) {
       snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("S.M.A.R.T. not available"));
@@ -113,9 +115,11 @@ static enum e_gettemp ata_get_temperature(struct disk *dsk) {
     dsk->fd = -1;
     return ret;
   }
+  dsk->caps |= CAP_SMART;
 
   if(ata_get_smart_values(dsk->fd, values)) {
     snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", strerror(errno));
+    dsk->caps = 0;
     close(dsk->fd);
     dsk->fd = -1;
     return GETTEMP_ERROR;
@@ -166,5 +170,7 @@ struct bustype ata_bus = {
   "PATA",
   ata_probe,
   ata_model,
-  ata_get_temperature
+  ata_get_temperature,
+  NULL,
+  NULL
 };
@@ -111,7 +111,9 @@ enum e_powermode ata_get_powermode(int device) {
       && (args[0] = WIN_CHECKPOWERMODE2) /* try again with 0x98 */
       && ioctl(device, HDIO_DRIVE_CMD, &args))
     {
-       if (errno != EIO || args[0] != 0 || args[1] != 0)
+       if (errno == EIO && (args[0] & 0x01) && (args[1] & 0x04))
+         state = PWM_UNSUPPORTED;   /* ERR with ABRT */
+       else if (errno != EIO || args[0] != 0 || args[1] != 0)
          state = PWM_UNKNOWN;
        else
          state = PWM_SLEEPING;
@@ -122,6 +124,43 @@ enum e_powermode ata_get_powermode(int device) {
   return state;
 }
 
+/* Whether to send CHECK POWER MODE before reading the drive, so as not
+   to wake it up.  A drive that doesn't support it is only read, but it
+   is asked again every POWERMODE_RETRY readings, in case the failures
+   were transient after all. */
+int ata_check_powermode(struct disk *dsk) {
+  if(wakeup)
+    return 0;
+
+  if((dsk->caps & CAP_NO_POWERMODE) && ++dsk->powermode_skips >= POWERMODE_RETRY) {
+    dsk->caps &= ~CAP_NO_POWERMODE;
+    dsk->powermode_failures = 0;
+  }
+
+  return !(dsk->caps & CAP_NO_POWERMODE);
+}
+
+/* Give CHECK POWER MODE up after the drive aborted it, or after it
+   failed POWERMODE_MAX_FAILURES times in a row. */
+void ata_powermode_result(struct disk *dsk, enum e_powermode state) {
+  switch(state) {
+  case PWM_UNSUPPORTED:
+    dsk->powermode_failures = POWERMODE_MAX_FAILURES;
+    break;
+  case PWM_UNKNOWN:
+    dsk->powermode_failures++;
+    break;
+  default:
+    dsk->powermode_failures = 0;
+    return;
+  }
+
+  if(dsk->powermode_failures >= POWERMODE_MAX_FAILURES) {
+    dsk->caps |= CAP_NO_POWERMODE;
+    dsk->powermode_skips = 0;
+  }
+}
+
 int ata_get_packet (int device) {
   unsigned short buf[256];
   if (!ioctl(device, HDIO_GET_IDENTITY, buf) && (buf[0] & 0x8000))
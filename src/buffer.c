@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+// Application specific includes
+#include "buffer.h"
+
+#define BUFFER_MIN_SIZE        256
+
+void buffer_init(struct buffer *buf) {
+  buf->data = NULL;
+  buf->len = 0;
+  buf->size = 0;
+}
+
+static void buffer_reserve(struct buffer *buf, size_t n) {
+  size_t  size;
+  char *  p;
+
+  if(buf->len + n < buf->size)
+    return;
+
+  size = buf->size ? buf->size : BUFFER_MIN_SIZE;
+  while(size <= buf->len + n)
+    size *= 2;
+
+  p = realloc(buf->data, size);
+  if(p == NULL) {
+    perror("realloc");
+    exit(-1);
+  }
+
+  buf->data = p;
+  buf->size = size;
+}
+
+void buffer_append(struct buffer *buf, const void *data, size_t n) {
+  buffer_reserve(buf, n);
+  memcpy(buf->data + buf->len, data, n);
+  buf->len += n;
+  buf->data[buf->len] = '\0';
+}
+
+void buffer_printf(struct buffer *buf, const char *fmt, ...) {
+  va_list ap;
+  int     n;
+
+  buffer_reserve(buf, 0);
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+  va_end(ap);
+  if(n < 0)
+    return;
+
+  if((size_t) n >= buf->size - buf->len) {
+    buffer_reserve(buf, n);
+
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->len, buf->size - buf->len, fmt, ap);
+    va_end(ap);
+  }
+
+  buf->len += n;
+}
+
+/* Length of the well-formed UTF-8 sequence at p, or 0: overlong forms,
+   surrogates and code points past U+10FFFF are rejected. */
+static int utf8_sequence(const unsigned char *p) {
+  unsigned char  lo = 0x80, hi = 0xbf;
+  int            n, i;
+
+  if(*p < 0x80)
+    return 1;
+  else if(*p >= 0xc2 && *p <= 0xdf)
+    n = 2;
+  else if(*p >= 0xe0 && *p <= 0xef) {
+    n = 3;
+    if(*p == 0xe0)
+      lo = 0xa0;
+    else if(*p == 0xed)
+      hi = 0x9f;
+  }
+  else if(*p >= 0xf0 && *p <= 0xf4) {
+    n = 4;
+    if(*p == 0xf0)
+      lo = 0x90;
+    else if(*p == 0xf4)
+      hi = 0x8f;
+  }
+  else
+    return 0;
+
+  if(p[1] < lo || p[1] > hi)
+    return 0;
+  for(i = 2; i < n; i++)
+    if(p[i] < 0x80 || p[i] > 0xbf)
+      return 0;
+
+  return n;
+}
+
+/* Append str as a quoted JSON string, or null.  UTF-8 is copied as is,
+   control characters are escaped and any byte that isn't part of valid
+   UTF-8 becomes U+FFFD, so that the output stays valid whatever a drive
+   reports as its model. */
+void buffer_json_string(struct buffer *buf, const char *str) {
+  const unsigned char *p;
+  int                  n;
+
+  if(str == NULL) {
+    buffer_append(buf, "null", 4);
+    return;
+  }
+
+  buffer_append(buf, "\"", 1);
+  for(p = (const unsigned char *) str; *p; p += n) {
+    n = 1;
+    switch(*p) {
+    case '"':
+      buffer_append(buf, "\\\"", 2);
+      break;
+    case '\\':
+      buffer_append(buf, "\\\\", 2);
+      break;
+    case '\n':
+      buffer_append(buf, "\\n", 2);
+      break;
+    case '\t':
+      buffer_append(buf, "\\t", 2);
+      break;
+    default:
+      if(*p < 0x20 || *p == 0x7f)
+        buffer_printf(buf, "\\u%04x", *p);
+      else if((n = utf8_sequence(p)) == 0) {
+        buffer_append(buf, "\\ufffd", 6);
+        n = 1;
+      }
+      else
+        buffer_append(buf, p, n);
+      break;
+    }
+  }
+  buffer_append(buf, "\"", 1);
+}
+
+void buffer_free(struct buffer *buf) {
+  free(buf->data);
+  buffer_init(buf);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
+
+#include <stddef.h>
+
+struct buffer {
+  char *    data;
+  size_t    len;
+  size_t    size;
+};
+
+void buffer_init(struct buffer *buf);
+void buffer_append(struct buffer *buf, const void *data, size_t n);
+void buffer_printf(struct buffer *buf, const char *fmt, ...)
+  __attribute__ ((format (printf, 2, 3)));
+void buffer_json_string(struct buffer *buf, const char *str);
+void buffer_free(struct buffer *buf);
+
+#endif
@@ -16,6 +16,8 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _GNU_SOURCE
+
 // Include file generated by ./configure
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -34,42 +36,138 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/netlink.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <signal.h>
 #include <netinet/in.h>
 #include <syslog.h>
+#include <pthread.h>
 
 // Application specific includes
 #include "hddtemp.h"
+#include "pool.h"
+#include "buffer.h"
+#include "wheel.h"
+#include "sysfs.h"
+#include "sgasync.h"
+#include "uring.h"
 
-#define DELAY                  60.0
+#define CLIENT_TIMEOUT         30000   /* ms without progress before a client is dropped */
+#define MAX_EVENTS             64
+#define MAX_REQUEST_SIZE       8192    /* bytes of HTTP request headers we accept */
+#define RATE_WEIGHT            0.5     /* weight of the newest sample in the rate average */
+#define REOPEN_DELAY           2000    /* ms before a failed drive is first reopened, */
+#define REOPEN_MAX_DELAY       600000  /* doubled after each attempt up to this */
+#define REOPEN_PER_SWEEP       2       /* failed drives retried in a single sweep */
+#define UEVENT_BUFFER_SIZE     8192
 
 int                sks_serv_num = 0;
-int *              sks_serv;
+int *              sks_serv = NULL;
+int *              sks_proto = NULL;
 int                stop_daemon = 0;
+static struct pool *poller = NULL;
+
+enum { PROTO_HDDTEMP, PROTO_HTTP, PROTO_UEVENT, PROTO_SIGNAL, PROTO_WATCH };
+
+/* Copy of a disk state, for replies built at request time. */
+struct sample {
+  char *          drive;
+  char *          model;
+  const char *    bus;
+  enum e_gettemp  ret;
+  int             celsius;
+  time_t          last_time;
+};
+
+/* Reply sent to TCP clients.  The sampler thread renders a new one after
+   each refresh and swaps it in; clients hold a reference while they
+   write it out, so a published snapshot is never modified. */
+struct snapshot {
+  int             refs;
+  struct buffer   reply;
+  int             nsamples;
+  struct sample * samples;
+};
+
+static pthread_mutex_t  snap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct snapshot *snap_current = NULL;
+
+/* A listening socket or a client still being sent its snapshot.  Clients
+   waiting for their socket to drain are kept on a list ordered by
+   deadline, oldest first. */
+struct conn {
+  struct conn *      prev;
+  struct conn *      next;
+  int                fd;
+  int                listening;
+  int                proto;
+  int                reading;       /* still waiting for the HTTP request */
+  struct buffer      in;
+  struct buffer      out;           /* private reply, if not the snapshot one */
+  struct snapshot *  snap;
+  size_t             off;
+  long               deadline;
+};
+
+static struct conn      idle_head = { &idle_head, &idle_head, -1, 0, 0, 0,
+                                      { NULL, 0, 0 }, { NULL, 0, 0 }, NULL, 0, 0 };
+static struct conn *    listeners = NULL;
+static int              epfd = -1;
+static int              spare_fd = -1;
+
+static pthread_mutex_t  sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   sampler_wake;
+static int              sampler_stop = 0;
+static int              sampler_reload = 0;
+static struct timer     syslog_timer;
+static struct disk *    disks = NULL;
+static struct disk **   due_disks = NULL;
+static int              ndisks = 0;
+
+/* --hotplug: block devices added or removed, handed over by the main
+   loop to the sampler, which owns the disk list */
+struct uevent {
+  struct uevent *    next;
+  int                add;
+  char               name[];
+};
+
+static struct uevent *  uevents = NULL;
+static struct uevent ** uevents_tail = &uevents;
+
+static const char *     database_name = NULL;   /* in its watched directory */
+static int              database_wd = -1;
+static int              dropins_wd = -1;
 
 /*******************************************************
  *******************************************************/
 
-void daemon_open_sockets(void)
+static void daemon_open_sockets(long port, int proto)
 {
   struct addrinfo*   all_ai;
   struct addrinfo    hints;
   struct addrinfo*   resp;
   char               portbuf[10];
   int                on = 1;
-  int                ret;
+  int                ret, first;
 
   memset(&hints, 0, sizeof hints);
   hints.ai_family = af_hint;
   hints.ai_socktype = SOCK_STREAM;
   hints.ai_flags = AI_PASSIVE;
-  snprintf(portbuf, sizeof(portbuf), "%ld", portnum);
+  snprintf(portbuf, sizeof(portbuf), "%ld", port);
   ret = getaddrinfo(listen_addr, portbuf, &hints, &all_ai);
   if (ret != 0) {
     fprintf(stderr, "getaddrinfo: %s\n", gai_strerror(ret));
@@ -77,10 +175,11 @@ void daemon_open_sockets(void)
   }
 
   /* Count max number of sockets we might open. */
-  for (sks_serv_num = 0, resp = all_ai ; resp ; resp = resp->ai_next)
-    sks_serv_num++;
-  sks_serv = malloc(sizeof(int) * sks_serv_num);
-  if (!sks_serv) {
+  for (ret = sks_serv_num, resp = all_ai ; resp ; resp = resp->ai_next)
+    ret++;
+  sks_serv = realloc(sks_serv, sizeof(int) * ret);
+  sks_proto = realloc(sks_proto, sizeof(int) * ret);
+  if (!sks_serv || !sks_proto) {
     perror("malloc");
     freeaddrinfo(all_ai);
     exit(1);
@@ -89,7 +188,7 @@ void daemon_open_sockets(void)
   /* We may not be able to create the socket, if for example the
    * machine knows about IPv6 in the C library, but not in the
    * kernel. */
-  for (sks_serv_num = 0, resp = all_ai; resp; resp = resp->ai_next) {
+  for (first = sks_serv_num, resp = all_ai; resp; resp = resp->ai_next) {
     sks_serv[sks_serv_num] = socket(resp->ai_family, resp->ai_socktype, resp->ai_protocol); 
     if (sks_serv[sks_serv_num] == -1)
       /* See if there's another address that will work... */
@@ -108,20 +207,25 @@ void daemon_open_sockets(void)
       continue;
     }
 
+    /* Clients are accepted from the event loop until EAGAIN */
+    fcntl(sks_serv[sks_serv_num], F_SETFL, O_NONBLOCK);
+    fcntl(sks_serv[sks_serv_num], F_SETFD, FD_CLOEXEC);
+
     /* Ready to listen */
-    if (listen(sks_serv[sks_serv_num], 5) == -1) {
+    if (listen(sks_serv[sks_serv_num], listen_backlog) == -1) {
       perror("listen");
-      for (sks_serv_num-- ; sks_serv_num > 0 ; sks_serv_num--)
+      for (sks_serv_num-- ; sks_serv_num >= 0 ; sks_serv_num--)
         close(sks_serv[sks_serv_num]);
       freeaddrinfo(all_ai);
       free(sks_serv);
       exit(1);
     }
 
+    sks_proto[sks_serv_num] = proto;
     sks_serv_num++;
   }
 
-  if (sks_serv_num == 0) {
+  if (sks_serv_num == first) {
     perror("socket");
     free(sks_serv);
     freeaddrinfo(all_ai);
@@ -131,20 +235,278 @@ void daemon_open_sockets(void)
   freeaddrinfo(all_ai);
 }
 
-void daemon_update(struct disk *ldisks, int nocache) {
-  struct disk *      dsk;
+/* local consumers can avoid the TCP stack altogether */
+static void daemon_open_unix_socket(const char *path, mode_t mode)
+{
+  struct sockaddr_un sun;
+  struct stat        st;
+  int                sk;
 
-  for(dsk = ldisks; dsk; dsk = dsk->next) {
-    if(nocache || (difftime(time(NULL), dsk->last_time) > DELAY)) {
-      dsk->value = -1;
+  if(strlen(path) >= sizeof(sun.sun_path)) {
+    fprintf(stderr, _("ERROR: unix socket path too long: %s\n"), path);
+    exit(1);
+  }
 
-      if(dsk->type == ERROR)
-        dsk->ret = GETTEMP_ERROR;
-      else 
-        dsk->ret = bus[dsk->type]->get_temperature(dsk);
+  memset(&sun, 0, sizeof sun);
+  sun.sun_family = AF_UNIX;
+  strcpy(sun.sun_path, path);
+
+  /* a socket left behind by a previous instance would make bind() fail */
+  if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+
+  sk = socket(AF_UNIX, SOCK_STREAM, 0);
+  if(sk == -1) {
+    perror("socket");
+    exit(1);
+  }
+
+  if(bind(sk, (struct sockaddr *) &sun, sizeof sun) == -1) {
+    perror("bind");
+    close(sk);
+    exit(1);
+  }
+
+  if(chmod(path, mode) == -1) {
+    perror("chmod");
+    close(sk);
+    unlink(path);
+    exit(1);
+  }
+
+  fcntl(sk, F_SETFL, O_NONBLOCK);
+  fcntl(sk, F_SETFD, FD_CLOEXEC);
+
+  if(listen(sk, listen_backlog) == -1) {
+    perror("listen");
+    close(sk);
+    unlink(path);
+    exit(1);
+  }
+
+  sks_serv = realloc(sks_serv, sizeof(int) * (sks_serv_num + 1));
+  sks_proto = realloc(sks_proto, sizeof(int) * (sks_serv_num + 1));
+  if (!sks_serv || !sks_proto) {
+    perror("malloc");
+    exit(1);
+  }
+
+  sks_serv[sks_serv_num] = sk;
+  sks_proto[sks_serv_num] = PROTO_HDDTEMP;
+  sks_serv_num++;
+}
+
+static void daemon_add_listener(int sk, int proto)
+{
+  sks_serv = realloc(sks_serv, sizeof(int) * (sks_serv_num + 1));
+  sks_proto = realloc(sks_proto, sizeof(int) * (sks_serv_num + 1));
+  if (!sks_serv || !sks_proto) {
+    perror("malloc");
+    exit(1);
+  }
+
+  sks_serv[sks_serv_num] = sk;
+  sks_proto[sks_serv_num] = proto;
+  sks_serv_num++;
+}
+
+/* --hotplug: kernel uevents, or a datagram socket to inject some */
+static void daemon_open_uevent(void)
+{
+  struct sockaddr_un sun;
+  struct sockaddr_nl snl;
+  struct stat        st;
+  int                sk;
+
+  if(uevent_path) {
+    if(strlen(uevent_path) >= sizeof(sun.sun_path)) {
+      fprintf(stderr, _("ERROR: unix socket path too long: %s\n"), uevent_path);
+      exit(1);
+    }
+
+    memset(&sun, 0, sizeof sun);
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, uevent_path);
 
+    if(lstat(uevent_path, &st) == 0 && S_ISSOCK(st.st_mode))
+      unlink(uevent_path);
+
+    sk = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(sk == -1 || bind(sk, (struct sockaddr *) &sun, sizeof sun) == -1) {
+      perror("uevent socket");
+      exit(1);
+    }
+    chmod(uevent_path, 0600);
+  }
+  else {
+    memset(&snl, 0, sizeof snl);
+    snl.nl_family = AF_NETLINK;
+    snl.nl_groups = 1;      /* kernel events, not the ones relayed by udev */
+
+    sk = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if(sk == -1 || bind(sk, (struct sockaddr *) &snl, sizeof snl) == -1) {
+      perror("netlink");
+      exit(1);
+    }
+  }
+
+  daemon_add_listener(sk, PROTO_UEVENT);
+}
+
+/* The database is reloaded on SIGHUP, which the caller has blocked, and
+   when it, the image compiled from it or a drop-in file is written,
+   replaced or removed. */
+static void daemon_open_reload(const sigset_t *hup)
+{
+  char *  dir;
+  char *  p;
+  int     fd;
+
+  fd = signalfd(-1, hup, SFD_NONBLOCK | SFD_CLOEXEC);
+  if(fd == -1) {
+    perror("signalfd");
+    exit(1);
+  }
+  daemon_add_listener(fd, PROTO_SIGNAL);
+
+  /* editors and --compile-db rename a new file over the old one, so the
+     directory is watched rather than the file */
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd == -1)
+    return;
+
+  /* the paths are only left relative when getcwd() failed, and they
+     don't lead to the database anymore once in "/" */
+  if(database_path[0] == '/') {
+    dir = strdup(database_path);
+    if(dir == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    p = strrchr(dir, '/');
+    database_name = database_path + (p - dir) + 1;
+    if(p == dir)
+      p++;
+    *p = '\0';
+
+    database_wd = inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+    free(dir);
+  }
+  else
+    syslog(LOG_WARNING, _("%s is a relative path, changes to it are not watched"), database_path);
+
+  if(database_dir[0] == '/')
+    dropins_wd = inotify_add_watch(fd, database_dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+  else if(database_dir[0] != '\0')
+    syslog(LOG_WARNING, _("%s is a relative path, changes to it are not watched"), database_dir);
+
+  if(database_wd == -1 && dropins_wd == -1)
+    close(fd);
+  else
+    daemon_add_listener(fd, PROTO_WATCH);
+}
+
+static void daemon_read_done(struct disk *dsk) {
+  /* the bus drivers close the device on errors */
+  if(dsk->ret == GETTEMP_ERROR)
+    dsk->failures++;
+  else
+    dsk->failures = 0;
+
+  time(&dsk->last_time);
+}
+
+static void daemon_poll_disk(void *arg) {
+  struct disk * dsk = (struct disk *) arg;
+  int           tries;
+
+  dsk->value = -1;
+
+  if(dsk->fd == -1) {
+    /* drives without a sensor or S.M.A.R.T. are closed on purpose and
+       keep their answer, any other closed drive is reopened */
+    if(dsk->ret == GETTEMP_NOSENSOR || dsk->ret == GETTEMP_NOT_APPLICABLE) {
       time(&dsk->last_time);
+      return;
     }
+
+    /* a drive seen through several paths moves on to another one after
+       an error, and tries each before giving up */
+    if(dsk->failures > 0)
+      disk_failover(dsk);
+    for(tries = 0; dsk->aliases && dsk->aliases[tries]; tries++)
+      ;
+
+    while(disk_open(dsk) == -1) {
+      if(tries-- == 0 || !disk_failover(dsk)) {
+        dsk->type = ERROR;
+        dsk->ret = GETTEMP_ERROR;
+        dsk->failures++;
+        time(&dsk->last_time);
+        return;
+      }
+    }
+    set_interval(dsk);
+  }
+
+  dsk->ret = bus[dsk->type]->get_temperature(dsk);
+  daemon_read_done(dsk);
+}
+
+/* Each disk only touches its own struct disk, so they can be queried
+   in parallel and a slow drive no longer delays the others.  Drives
+   whose bus driver can read them asynchronously (sg nodes, io_uring
+   passthrough) are all sent their commands first, the pool reads the
+   rest meanwhile, and the answers are collected afterwards. */
+static void daemon_update(struct disk **due, int n) {
+  struct disk *dsk;
+  int          i, j, nasync = 0, nshared = 0;
+
+  /* namespaces of an NVMe controller due in the same sweep share the
+     reading of the first one, they are moved to the end */
+  for(i = 0; i < n - nshared; i++) {
+    dsk = due[i];
+    if(dsk->fd == -1 || dsk->controller == NULL)
+      continue;
+
+    for(j = 0; j < i; j++) {
+      if(due[j]->fd != -1 && due[j]->controller &&
+         strcmp(due[j]->controller, dsk->controller) == 0)
+        break;
+    }
+    if(j == i)
+      continue;
+
+    dsk->leader = due[j];
+    nshared++;
+    due[i--] = due[n - nshared];
+    due[n - nshared] = dsk;
+  }
+  n -= nshared;
+
+  for(i = 0; i < n; i++) {
+    dsk = due[i];
+
+    if(dsk->fd != -1 && bus[dsk->type]->submit &&
+       bus[dsk->type]->submit(dsk) == 0) {
+      due[i] = due[nasync];
+      due[nasync++] = dsk;
+    }
+  }
+
+  uring_flush();
+
+  pool_run(poller, daemon_poll_disk, (void **) due + nasync, n - nasync);
+  sg_reap(due, nasync, daemon_read_done);
+  uring_reap(due, nasync, daemon_read_done);
+
+  for(i = n; i < n + nshared; i++) {
+    dsk = due[i];
+    dsk->value = dsk->leader->value;
+    dsk->ret = dsk->leader->ret;
+    memcpy(dsk->errormsg, dsk->leader->errormsg, MAX_ERRORMSG_SIZE);
+    dsk->leader = NULL;
+    daemon_read_done(dsk);
   }
 }
 
@@ -153,69 +515,574 @@ void daemon_close_sockets(void) {
 
   for (i = 0 ; i < sks_serv_num; i++)
     close(sks_serv[i]);
+
+  if (unix_path)
+    unlink(unix_path);
+  if (uevent_path)
+    unlink(uevent_path);
 }
 
-void daemon_send_msg(struct disk *ldisks, int cfd) {
-  struct disk * dsk;
+static struct snapshot *snapshot_get(void) {
+  struct snapshot *snap;
+
+  pthread_mutex_lock(&snap_lock);
+  snap = snap_current;
+  if(snap)
+    snap->refs++;
+  pthread_mutex_unlock(&snap_lock);
+
+  return snap;
+}
+
+static void snapshot_put(struct snapshot *snap) {
+  int refs;
+
+  if(snap == NULL)
+    return;
+
+  pthread_mutex_lock(&snap_lock);
+  refs = --snap->refs;
+  pthread_mutex_unlock(&snap_lock);
+
+  if(refs == 0) {
+    int i;
+
+    for(i = 0; i < snap->nsamples; i++) {
+      free(snap->samples[i].drive);
+      free(snap->samples[i].model);
+    }
+    free(snap->samples);
+    buffer_free(&snap->reply);
+    free(snap);
+  }
+}
+
+static void snapshot_publish(struct snapshot *snap) {
+  struct snapshot *old;
+
+  pthread_mutex_lock(&snap_lock);
+  old = snap_current;
+  snap_current = snap;
+  pthread_mutex_unlock(&snap_lock);
+
+  snapshot_put(old);
+}
+
+static struct snapshot *daemon_render(struct disk *ldisks) {
+  struct disk *     dsk;
+  struct snapshot * snap;
+  int               i;
+
+  snap = (struct snapshot *) malloc(sizeof(struct snapshot));
+  if(snap == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  snap->refs = 1;
+  buffer_init(&snap->reply);
+
+  for(snap->nsamples = 0, dsk = ldisks; dsk; dsk = dsk->next)
+    snap->nsamples++;
+  snap->samples = (struct sample *) calloc(snap->nsamples ? snap->nsamples : 1, sizeof(struct sample));
+  if(snap->samples == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  for(i = 0, dsk = ldisks; dsk; dsk = dsk->next, i++) {
+    struct sample *sp = &snap->samples[i];
 
-  daemon_update(ldisks, 0);
+    sp->drive = strdup(dsk->drive);
+    sp->model = strdup(dsk->model ? dsk->model : "???");
+    sp->bus = (dsk->type > BUS_UNKNOWN && bus[dsk->type]) ? bus[dsk->type]->name : "unknown";
+    sp->ret = dsk->ret;
+    if(dsk->ret == GETTEMP_KNOWN && dsk->db_entry && dsk->db_entry->unit == 'F')
+      sp->celsius = F_to_C(dsk->value);
+    else
+      sp->celsius = dsk->value;
+    sp->last_time = dsk->last_time;
+  }
+
+  /* the whole reply goes in one buffer so that it leaves in a single
+     send() and as few TCP segments as its size allows */
+  if(output_format == FORMAT_JSON) {
+    buffer_append(&snap->reply, "[", 1);
+    for(dsk = ldisks; dsk; dsk = dsk->next) {
+      buffer_append(&snap->reply, "\n", 1);
+      disk_json(&snap->reply, dsk);
+      if(dsk->next)
+        buffer_append(&snap->reply, ",", 1);
+    }
+    buffer_append(&snap->reply, "\n]\n", 3);
+
+    return snap;
+  }
 
   for(dsk = ldisks; dsk; dsk = dsk->next) {
-    char msg[128];
-    int n;
+    const char *status;
 
     switch(dsk->ret) {
+    case GETTEMP_KNOWN:
+      buffer_printf(&snap->reply, "%c%s%c%s%c%d%c%c%c",
+                    separator,
+                    dsk->drive,          separator,
+                    dsk->model,          separator,
+                    value_to_unit(dsk),  separator,
+                    get_unit(dsk),
+                    separator);
+      continue;
     case GETTEMP_NOT_APPLICABLE:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%cNA%c*",
-                   dsk->drive, separator,
-                   dsk->model, separator,
-                   separator);
+      status = "NA";
       break;
     case GETTEMP_UNKNOWN:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%cUNK%c*",
-                   dsk->drive, separator,
-                   dsk->model, separator, 
-                   separator);
-      break;
-    case GETTEMP_KNOWN:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%c%d%c%c",
-                   dsk->drive,          separator,
-                   dsk->model,          separator,
-                   value_to_unit(dsk),  separator,
-                   get_unit(dsk));
+      status = "UNK";
       break;
     case GETTEMP_NOSENSOR:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%cNOS%c*",
-                   dsk->drive, separator,
-                   dsk->model, separator,
-                   separator);
+      status = "NOS";
       break;
     case GETTEMP_DRIVE_SLEEP:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%cSLP%c*",
-                   dsk->drive, separator,
-                   dsk->model, separator,
-                   separator);
+      status = "SLP";
       break;
     case GETTEMP_ERROR:
     default:
-      n = snprintf(msg, sizeof(msg), "%s%c%s%cERR%c*",
-                   dsk->drive,                        separator,
-                   (dsk->model) ? dsk->model : "???", separator,
-                   separator);
+      status = "ERR";
+      break;
+    }
+
+    buffer_printf(&snap->reply, "%c%s%c%s%c%s%c*%c",
+                  separator,
+                  dsk->drive,                        separator,
+                  (dsk->model) ? dsk->model : "???", separator,
+                  status,                            separator,
+                  separator);
+  }
+
+  return snap;
+}
+
+static void metrics_label(struct buffer *out, const char *name, const char *value) {
+  const char *p;
+
+  buffer_printf(out, "%s=\"", name);
+  for(p = value; *p; p++) {
+    switch(*p) {
+    case '\\':
+      buffer_append(out, "\\\\", 2);
+      break;
+    case '"':
+      buffer_append(out, "\\\"", 2);
+      break;
+    case '\n':
+      buffer_append(out, "\\n", 2);
+      break;
+    default:
+      buffer_append(out, p, 1);
+      break;
+    }
+  }
+  buffer_append(out, "\"", 1);
+}
+
+/* OpenMetrics text exposition of a snapshot.  Only the age of the
+   readings depends on the time of the request. */
+static void daemon_metrics(struct buffer *out, struct snapshot *snap) {
+  time_t now = time(NULL);
+  int    i;
+
+  buffer_printf(out,
+                "# TYPE hddtemp_temperature_celsius gauge\n"
+                "# UNIT hddtemp_temperature_celsius celsius\n"
+                "# HELP hddtemp_temperature_celsius Drive temperature.\n");
+  for(i = 0; i < snap->nsamples; i++) {
+    struct sample *sp = &snap->samples[i];
+
+    if(sp->ret != GETTEMP_KNOWN)
+      continue;
+    buffer_append(out, "hddtemp_temperature_celsius{", 28);
+    metrics_label(out, "drive", sp->drive);
+    buffer_append(out, ",", 1);
+    metrics_label(out, "model", sp->model);
+    buffer_append(out, ",", 1);
+    metrics_label(out, "bus", sp->bus);
+    buffer_printf(out, "} %d\n", sp->celsius);
+  }
+
+  buffer_printf(out,
+                "# TYPE hddtemp_drive_status gauge\n"
+                "# HELP hddtemp_drive_status Outcome of the last reading, as the status label.\n");
+  for(i = 0; i < snap->nsamples; i++) {
+    struct sample *sp = &snap->samples[i];
+
+    buffer_append(out, "hddtemp_drive_status{", 21);
+    metrics_label(out, "drive", sp->drive);
+    buffer_append(out, ",", 1);
+    metrics_label(out, "model", sp->model);
+    buffer_append(out, ",", 1);
+    metrics_label(out, "bus", sp->bus);
+    buffer_append(out, ",", 1);
+    metrics_label(out, "status", gettemp_name(sp->ret));
+    buffer_append(out, "} 1\n", 4);
+  }
+
+  buffer_printf(out,
+                "# TYPE hddtemp_sample_age_seconds gauge\n"
+                "# UNIT hddtemp_sample_age_seconds seconds\n"
+                "# HELP hddtemp_sample_age_seconds Time since the drive was last read.\n");
+  for(i = 0; i < snap->nsamples; i++) {
+    struct sample *sp = &snap->samples[i];
+
+    buffer_append(out, "hddtemp_sample_age_seconds{", 27);
+    metrics_label(out, "drive", sp->drive);
+    buffer_printf(out, "} %ld\n", (long) difftime(now, sp->last_time));
+  }
+
+  buffer_append(out, "# EOF\n", 6);
+}
+
+/* Answer the HTTP request held in c->in. */
+static void http_respond(struct conn *c) {
+  struct buffer  body;
+  const char *   status;
+  const char *   type = "text/plain; charset=utf-8";
+  char *         path, *end;
+  int            head;
+
+  buffer_init(&body);
+
+  head = (strncmp(c->in.data, "HEAD ", 5) == 0);
+  if(strncmp(c->in.data, "GET ", 4) != 0 && !head) {
+    status = "405 Method Not Allowed";
+    buffer_printf(&body, "Method Not Allowed\n");
+  }
+  else {
+    path = c->in.data + (head ? 5 : 4);
+    end = path + strcspn(path, " ?\r\n");
+
+    if(end - path == 8 && strncmp(path, "/metrics", 8) == 0) {
+      status = "200 OK";
+      type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+      daemon_metrics(&body, c->snap);
+    }
+    else {
+      status = "404 Not Found";
+      buffer_printf(&body, "Not Found\n");
+    }
+  }
+
+  buffer_printf(&c->out,
+                "HTTP/1.0 %s\r\n"
+                "Content-Type: %s\r\n"
+                "Content-Length: %lu\r\n"
+                "Connection: close\r\n"
+                "\r\n",
+                status, type, (unsigned long) body.len);
+  if(!head && body.len)
+    buffer_append(&c->out, body.data, body.len);
+
+  buffer_free(&body);
+}
+
+/* Read what the client sent so far.  Returns 1 once the request headers
+   are complete, 0 if more is expected and -1 on error. */
+static int conn_read(struct conn *c) {
+  char    chunk[1024];
+  ssize_t n;
+  int     eof = 0;
+
+  while(1) {
+    n = recv(c->fd, chunk, sizeof(chunk), 0);
+    if(n > 0) {
+      buffer_append(&c->in, chunk, n);
+      if(c->in.len > MAX_REQUEST_SIZE)
+        return -1;
+    }
+    else if(n == 0) {
+      /* a client may shut its side down once the request is sent */
+      eof = 1;
+      break;
+    }
+    else if(errno == EINTR)
+      continue;
+    else if(errno == EAGAIN || errno == EWOULDBLOCK)
+      break;
+    else
+      return -1;
+  }
+
+  if(c->in.len && (strstr(c->in.data, "\r\n\r\n") || strstr(c->in.data, "\n\n")))
+    return 1;
+
+  return eof ? -1 : 0;
+}
+
+static long daemon_clock(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void conn_unlink(struct conn *c) {
+  c->prev->next = c->next;
+  c->next->prev = c->prev;
+  c->prev = c->next = c;
+}
+
+static void conn_touch(struct conn *c) {
+  conn_unlink(c);
+  c->deadline = daemon_clock() + CLIENT_TIMEOUT;
+  c->prev = idle_head.prev;
+  c->next = &idle_head;
+  idle_head.prev->next = c;
+  idle_head.prev = c;
+}
+
+static void conn_close(struct conn *c) {
+  conn_unlink(c);
+  close(c->fd);
+  snapshot_put(c->snap);
+  buffer_free(&c->in);
+  buffer_free(&c->out);
+  free(c);
+}
+
+/* Write as much of the reply as the socket takes.  Returns 1 once the
+   whole reply is out, 0 if the socket is full and -1 on error. */
+static int conn_flush(struct conn *c) {
+  struct buffer *reply;
+  ssize_t        n;
+
+  reply = (c->proto == PROTO_HTTP) ? &c->out : &c->snap->reply;
+
+  while(c->off < reply->len) {
+    n = send(c->fd, reply->data + c->off, reply->len - c->off, MSG_NOSIGNAL);
+    if(n > 0)
+      c->off += n;
+    else if(n == -1 && errno == EINTR)
+      continue;
+    else if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return 0;
+    else
+      return -1;
+  }
+
+  return 1;
+}
+
+/* Make progress on a client: read its request if any is expected, then
+   write the reply.  The connection is closed once done or on error. */
+static void conn_event(struct conn *c) {
+  if(c->reading) {
+    switch(conn_read(c)) {
+    case 0:
+      conn_touch(c);
+      return;
+    case 1:
+      c->reading = 0;
+      http_respond(c);
+      break;
+    default:
+      conn_close(c);
+      return;
+    }
+  }
+
+  switch(conn_flush(c)) {
+  case 0:
+    conn_touch(c);
+    break;
+  default:
+    conn_close(c);
+    break;
+  }
+}
+
+static void daemon_accept(struct conn *l) {
+  struct epoll_event ev;
+  struct conn *      c;
+  int                cfd;
+
+  while(1) {
+    cfd = accept4(l->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(cfd == -1) {
+      if(errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if((errno == EMFILE || errno == ENFILE) && spare_fd != -1) {
+        /* out of descriptors: drop the pending client rather than
+           leaving it queued with no further edge to wake us up */
+        close(spare_fd);
+        cfd = accept(l->fd, NULL, NULL);
+        if(cfd != -1)
+          close(cfd);
+        spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        continue;
+      }
+      return;
+    }
+
+    c = (struct conn *) calloc(1, sizeof(struct conn));
+    if(c == NULL) {
+      close(cfd);
+      continue;
+    }
+    c->prev = c->next = c;
+    c->fd = cfd;
+    c->proto = l->proto;
+    c->snap = snapshot_get();
+
+    if(c->snap == NULL) {
+      conn_close(c);
+      continue;
+    }
+
+    if(c->proto == PROTO_HDDTEMP) {
+      if(conn_flush(c) != 0) {
+        conn_close(c);
+        continue;
+      }
+
+      /* the reply did not fit in the socket buffer: finish it later */
+      ev.events = EPOLLOUT | EPOLLET;
+    }
+    else {
+      c->reading = 1;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    }
+
+    ev.data.ptr = c;
+    if(epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &ev) == -1) {
+      conn_close(c);
+      continue;
+    }
+
+    if(c->reading)
+      conn_event(c);
+    else
+      conn_touch(c);
+  }
+}
+
+/* Block disks added or removed, queued for the sampler.  Messages are
+   the kernel's: "ACTION@DEVPATH" then NUL-separated KEY=VALUE pairs. */
+static void daemon_uevent(struct conn *c) {
+  char               buf[UEVENT_BUFFER_SIZE];
+  struct sockaddr_nl snl;
+  socklen_t          len;
+  struct uevent *    ev;
+  const char *       action, *subsystem, *devtype, *devname;
+  char *             p;
+  ssize_t            n;
+
+  for(;;) {
+    len = sizeof(snl);
+    memset(&snl, 0, sizeof snl);
+    n = recvfrom(c->fd, buf, sizeof(buf) - 1, 0, (struct sockaddr *) &snl, &len);
+    if(n == -1) {
+      /* the kernel dropped events for us, take the next ones */
+      if(errno == ENOBUFS || errno == EINTR)
+        continue;
       break;
     }
-    (void)write(cfd, &separator, 1);
-    (void)write(cfd, &msg, n);
-    (void)write(cfd, &separator, 1);
+
+    /* anybody may send to the multicast group, only trust the kernel */
+    if(uevent_path == NULL && snl.nl_pid != 0)
+      continue;
+
+    buf[n] = '\0';
+    action = subsystem = devtype = devname = NULL;
+    for(p = buf; p < buf + n; p += strlen(p) + 1) {
+      if(strncmp(p, "ACTION=", 7) == 0)
+        action = p + 7;
+      else if(strncmp(p, "SUBSYSTEM=", 10) == 0)
+        subsystem = p + 10;
+      else if(strncmp(p, "DEVTYPE=", 8) == 0)
+        devtype = p + 8;
+      else if(strncmp(p, "DEVNAME=", 8) == 0)
+        devname = p + 8;
+    }
+
+    if(!action || !subsystem || !devtype || !devname ||
+       strcmp(subsystem, "block") != 0 || strcmp(devtype, "disk") != 0)
+      continue;
+    if(strcmp(action, "add") != 0 && strcmp(action, "remove") != 0)
+      continue;
+
+    ev = (struct uevent *) malloc(sizeof(struct uevent) + strlen(devname) + 1);
+    if(ev == NULL)
+      continue;
+    ev->next = NULL;
+    ev->add = (action[0] == 'a');
+    strcpy(ev->name, devname);
+
+    pthread_mutex_lock(&sampler_lock);
+    *uevents_tail = ev;
+    uevents_tail = &ev->next;
+    pthread_cond_signal(&sampler_wake);
+    pthread_mutex_unlock(&sampler_lock);
   }
 }
 
+/* SIGHUP, or a change to the database: the sampler reloads it before
+   its next sweep, once for any number of requests. */
+static void daemon_reload_event(struct conn *c) {
+  char                           buf[4096]
+                                   __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *   ev;
+  size_t                         len;
+  ssize_t                        n;
+  char *                         p;
+  int                            reload = 0;
+
+  while((n = read(c->fd, buf, sizeof(buf))) > 0) {
+    if(c->proto == PROTO_SIGNAL) {
+      reload = 1;
+      continue;
+    }
+
+    /* both watches are the same if the drop-in directory is the
+       database's */
+    len = database_name ? strlen(database_name) : 0;
+    for(p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len) {
+      ev = (const struct inotify_event *) p;
+      if(ev->len == 0)
+        continue;
+      if(ev->wd == database_wd && database_name && strncmp(ev->name, database_name, len) == 0 &&
+         (ev->name[len] == '\0' || strcmp(ev->name + len, DB_IMAGE_SUFFIX) == 0))
+        reload = 1;
+      if(ev->wd == dropins_wd && ev->name[0] != '.' && strlen(ev->name) > 3 &&
+         strcmp(ev->name + strlen(ev->name) - 3, ".db") == 0)
+        reload = 1;
+    }
+  }
+
+  if(reload) {
+    pthread_mutex_lock(&sampler_lock);
+    sampler_reload = 1;
+    pthread_cond_signal(&sampler_wake);
+    pthread_mutex_unlock(&sampler_lock);
+  }
+}
+
+static void daemon_expire(void) {
+  long now = daemon_clock();
+
+  while(idle_head.next != &idle_head && idle_head.next->deadline <= now)
+    conn_close(idle_head.next);
+}
+
+static int daemon_timeout(void) {
+  long delay;
+
+  if(idle_head.next == &idle_head)
+    return -1;
+
+  delay = idle_head.next->deadline - daemon_clock();
+  return (delay > 0) ? (int) delay : 0;
+}
 
 void daemon_syslog(struct disk *ldisks) {
   struct disk * dsk;
 
-  daemon_update(ldisks, 1);
-
   for(dsk = ldisks; dsk; dsk = dsk->next) {
     switch(dsk->ret) {
     case GETTEMP_KNOWN:
@@ -257,13 +1124,375 @@ void daemon_stop(int n) {
   stop_daemon = 1;
 }
 
+/* Delay before the next reading of a disk, in ms.  With --adaptive, the
+   delay is the time the drive is expected to take to move by one degree
+   at its recent rate of change: stable drives are read less and less
+   often, drives heating up or cooling down more often. */
+static long daemon_next_delay(struct disk *dsk, long now) {
+  double delay;
+  int    i;
+
+  /* a failed drive is reopened with an exponential backoff, starting
+     sooner than its interval so that a short outage heals quickly */
+  if (dsk->failures > 0) {
+    long retry = REOPEN_DELAY;
+
+    for (i = 1; i < dsk->failures && retry < REOPEN_MAX_DELAY; i++)
+      retry *= 2;
+
+    return (retry < REOPEN_MAX_DELAY) ? retry : REOPEN_MAX_DELAY;
+  }
+
+  if (adaptive_max == 0)
+    return dsk->interval * 1000;
+
+  if (dsk->ret != GETTEMP_KNOWN) {
+    dsk->prev_time = 0;
+    delay = dsk->interval;
+  }
+  else {
+    if (dsk->prev_time != 0 && now > dsk->prev_time) {
+      double rate;
+
+      rate = abs(dsk->value - dsk->prev_value) * 1000.0 / (now - dsk->prev_time);
+      dsk->rate = RATE_WEIGHT * rate + (1.0 - RATE_WEIGHT) * dsk->rate;
+    }
+    dsk->prev_value = dsk->value;
+    dsk->prev_time = now;
+
+    delay = (dsk->rate > 0.0) ? 1.0 / dsk->rate : adaptive_max;
+  }
+
+  if (delay < adaptive_min)
+    delay = adaptive_min;
+  else if (delay > adaptive_max)
+    delay = adaptive_max;
+
+  return (long) (delay * 1000);
+}
+
+/* The namespace that dsk, a namespace of an NVMe controller, is read
+   along with: the first open one of the controller in the list, or NULL
+   if that is dsk itself.  Only namespaces due in the same sweep share
+   a reading (see daemon_update), so they are all kept on its timer. */
+static struct disk *daemon_leader(struct disk *dsk) {
+  struct disk *p;
+
+  if(dsk->fd == -1 || dsk->controller == NULL)
+    return NULL;
+
+  for(p = disks; p && p != dsk; p = p->next)
+    if(p->fd != -1 && p->controller && strcmp(p->controller, dsk->controller) == 0)
+      return p;
+
+  return NULL;
+}
+
+/* Arm the timers of the n disks just read at "now". */
+static void daemon_schedule(struct disk **due, int n, long now) {
+  struct disk *leader;
+  int          i;
+
+  for (i = 0; i < n; i++)
+    wheel_add(&due[i]->timer, now + daemon_next_delay(due[i], now));
+
+  /* in a second pass, the leader may have been read in this sweep */
+  for (i = 0; i < n; i++) {
+    leader = daemon_leader(due[i]);
+    if (leader && leader->timer.next && leader->timer.next != &leader->timer)
+      wheel_add(&due[i]->timer, leader->timer.expires);
+  }
+}
+
+/* Read the disks due at "now" and arm their next readings.  Returns
+   how many were read; *log_due tells whether the syslog report is due
+   too. */
+static int daemon_sweep(long now, int *log_due) {
+  struct disk *   dsk;
+  struct timer *  t;
+  int             n = 0, retries = 0;
+
+  /* disks and the syslog report share a single due-queue */
+  *log_due = 0;
+  while((t = wheel_expired(now)) != NULL) {
+    if (t == &syslog_timer)
+      *log_due = 1;
+    else {
+      dsk = (struct disk *) t->data;
+
+      /* reopening a dead drive can take as long as the SCSI timeouts
+         of the probes, so only a few of them may hold up a sweep */
+      if (dsk->failures > 0 && ++retries > REOPEN_PER_SWEEP)
+        wheel_add(&dsk->timer, now + REOPEN_DELAY);
+      else
+        due_disks[n++] = dsk;
+    }
+  }
+
+  daemon_update(due_disks, n);
+  daemon_schedule(due_disks, n, now);
+
+  return n;
+}
+
+/* Arm the timers of the disks after their first reading, spreading the
+   next readings over each disk's interval rather than sweeping every
+   drive at the same instant. */
+static void daemon_start_timers(long now) {
+  struct disk *dsk, *leader;
+  int          i;
+
+  for(i = 0, dsk = disks; dsk; dsk = dsk->next, i++) {
+    dsk->timer.data = dsk;
+    if (dsk->failures > 0)
+      wheel_add(&dsk->timer, now + daemon_next_delay(dsk, now));
+    else if ((leader = daemon_leader(dsk)) != NULL)
+      wheel_add(&dsk->timer, leader->timer.expires);
+    else
+      wheel_add(&dsk->timer, now + dsk->interval * 1000 * (i + 1) / ndisks);
+  }
+  if (syslog_interval > 0)
+    wheel_add(&syslog_timer, now + syslog_interval * 1000);
+}
+
+static void daemon_free_disk(struct disk *dsk) {
+  if(dsk->fd != -1)
+    close(dsk->fd);
+  sg_release(dsk);
+  uring_release(dsk);
+  free((char *) dsk->drive);
+  free((char *) dsk->controller);
+  free(dsk->identity);
+  sysfs_free_list(dsk->aliases);
+  free((char *) dsk->model);
+  free(dsk->db_entry);
+  free(dsk);
+}
+
+/* Position of path among the failover paths of dsk, or -1. */
+static int daemon_alias(struct disk *dsk, const char *path) {
+  int i;
+
+  for(i = 0; dsk->aliases && dsk->aliases[i]; i++)
+    if(strcmp(dsk->aliases[i], path) == 0)
+      return i;
+
+  return -1;
+}
+
+static void daemon_alias_del(struct disk *dsk, int i) {
+  free(dsk->aliases[i]);
+  for(; dsk->aliases[i]; i++)
+    dsk->aliases[i] = dsk->aliases[i + 1];
+}
+
+static void daemon_alias_add(struct disk *dsk, const char *path) {
+  char ** aliases;
+  int     n;
+
+  for(n = 0; dsk->aliases && dsk->aliases[n]; n++)
+    ;
+
+  aliases = (char **) realloc(dsk->aliases, (n + 2) * sizeof(char *));
+  if(aliases == NULL || (aliases[n] = strdup(path)) == NULL) {
+    perror("realloc");
+    exit(-1);
+  }
+  aliases[n + 1] = NULL;
+  dsk->aliases = aliases;
+}
+
+/* Apply a uevent to the disk list.  A new disk is appended closed and
+   due at once, so that it gets opened and identified like a drive that
+   came back, with the same backoff if its node isn't there yet.  A new
+   path to a drive already in the list only becomes one of its failover
+   paths, and losing the path a drive is read through moves it on to
+   another one. */
+static int daemon_hotplug(struct uevent *ev, long now) {
+  struct disk ** pdsk;
+  struct disk *  dsk;
+  struct disk ** due;
+  char           path[PATH_MAX];
+  char           name[PATH_MAX];
+  char           dir[PATH_MAX + 16];
+  char *         identity;
+  char *         p;
+  int            alias = -1;
+
+  snprintf(path, sizeof(path), "/dev/%s", ev->name);
+  for(pdsk = &disks; (dsk = *pdsk) != NULL; pdsk = &dsk->next)
+    if(strcmp(dsk->drive, path) == 0 || (alias = daemon_alias(dsk, path)) != -1)
+      break;
+
+  if(!ev->add) {
+    if(dsk == NULL)
+      return 0;
+
+    if(alias != -1) {
+      daemon_alias_del(dsk, alias);
+      return 0;
+    }
+
+    wheel_del(&dsk->timer);
+    if(disk_failover(dsk)) {
+      for(alias = 0; dsk->aliases[alias + 1]; alias++)
+        ;
+      daemon_alias_del(dsk, alias);
+    }
+    else {
+      *pdsk = dsk->next;
+      daemon_free_disk(dsk);
+      ndisks--;
+      return 1;
+    }
+  }
+  else if(dsk != NULL && alias != -1)
+    return 0;
+  else if(dsk == NULL) {
+    /* cciss/c0d0 is cciss!c0d0 in sysfs */
+    snprintf(name, sizeof(name), "%s", ev->name);
+    for(p = name; *p; p++)
+      if(*p == '/')
+        *p = '!';
+    if(!sysfs_disk_wanted(name, include_patterns, exclude_patterns))
+      return 0;
+
+    snprintf(dir, sizeof(dir), "%s/block/%s", sysfs_root, name);
+    identity = sysfs_identity(dir);
+    if(identity) {
+      for(dsk = disks; dsk; dsk = dsk->next) {
+        if(dsk->identity && strcmp(dsk->identity, identity) == 0) {
+          daemon_alias_add(dsk, path);
+          free(identity);
+          return 0;
+        }
+      }
+    }
+
+    due = (struct disk **) realloc(due_disks, sizeof(struct disk *) * (ndisks + 1));
+    dsk = (struct disk *) calloc(1, sizeof(struct disk));
+    if(due == NULL || dsk == NULL || (dsk->drive = strdup(path)) == NULL) {
+      free(identity);
+      free(dsk);
+      return 0;
+    }
+    due_disks = due;
+
+    dsk->identity = identity;
+    dsk->timer.data = dsk;
+    set_interval(dsk);
+    *pdsk = dsk;
+    ndisks++;
+  }
+  else {
+    /* back in its bay, maybe another drive: identify it again */
+    wheel_del(&dsk->timer);
+    if(dsk->fd != -1)
+      close(dsk->fd);
+  }
+
+  dsk->fd = -1;
+  dsk->type = ERROR;
+  dsk->ret = GETTEMP_ERROR;
+  dsk->failures = 0;
+  wheel_add(&dsk->timer, now);
+
+  return 1;
+}
+
+/* Swap in the database again.  The sampler does it between two sweeps,
+   while no worker looks a drive up, and clients go on being served the
+   last readings.  A database that doesn't load leaves the current one
+   in place. */
+static void daemon_reload(void) {
+  struct database *  db, *old;
+  struct disk *      dsk;
+
+  db = read_database(database_path, database_dir);
+  if(db == NULL) {
+    syslog(LOG_ERR, _("can't reload %s, keeping the current database"), database_path);
+    return;
+  }
+
+  old = swap_database(db);
+  for(dsk = disks; dsk; dsk = dsk->next)
+    disk_lookup(dsk);
+  release_database(old);
+
+  syslog(LOG_INFO, _("reloaded %s"), database_path);
+}
+
+/* All disk I/O happens here, so that serving a client never waits for a
+   drive: readings are refreshed in the background and published as a
+   pre-rendered snapshot. */
+static void *daemon_sampler(void *arg) {
+  struct timespec    ts;
+  struct uevent *    ev, *next;
+  long               now, wake;
+  int                n, log_due, changed, reload;
+
+  (void)arg; /* unused */
+
+  pthread_mutex_lock(&sampler_lock);
+  while(!sampler_stop) {
+    /* the lock only guards the stop flag and the uevent queue, the
+       main loop must not wait for the drives */
+    ev = uevents;
+    uevents = NULL;
+    uevents_tail = &uevents;
+    reload = sampler_reload;
+    sampler_reload = 0;
+    pthread_mutex_unlock(&sampler_lock);
+
+    now = wheel_now();
+    for(changed = 0; ev; ev = next) {
+      next = ev->next;
+      changed |= daemon_hotplug(ev, now);
+      free(ev);
+    }
+
+    if (reload) {
+      daemon_reload();
+      changed = 1;
+    }
+
+    n = daemon_sweep(now, &log_due);
+
+    if (tcp_daemon && (n > 0 || changed))
+      snapshot_publish(daemon_render(disks));
+
+    if (log_due) {
+      daemon_syslog(disks);
+      wheel_add(&syslog_timer, now + syslog_interval * 1000);
+    }
+
+    pthread_mutex_lock(&sampler_lock);
+    if (sampler_stop || uevents != NULL || sampler_reload)
+      continue;
+
+    wake = wheel_next();
+    if (wake == -1)
+      pthread_cond_wait(&sampler_wake, &sampler_lock);
+    else {
+      ts.tv_sec = wake / 1000;
+      ts.tv_nsec = (wake % 1000) * 1000000;
+      pthread_cond_timedwait(&sampler_wake, &sampler_lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&sampler_lock);
+
+  return NULL;
+}
+
 void do_daemon_mode(struct disk *ldisks) {
   struct disk *      dsk;
-  int                cfd;
-  int                i, ret, maxfd;
-  struct tm *        time_st;
-  fd_set             deffds;
-  time_t             next_time;
+  struct conn *      c;
+  struct epoll_event events[MAX_EVENTS];
+  int                i, n, ret;
+  pthread_t          sampler;
+  pthread_condattr_t attr;
+  sigset_t           all, old, hup;
+  char *             cwd;
 
 if (!foreground) {
     switch(fork()) {
@@ -290,6 +1519,17 @@ if (!foreground) {
       exit(0);
     }
   }
+  /* the database is read again after the chdir() */
+  if ((cwd = getcwd(NULL, 0)) != NULL) {
+    if (database_path[0] != '/' &&
+        asprintf(&database_path, "%s/%s", cwd, database_path) == -1)
+      exit(1);
+    if (database_dir[0] != '/' && database_dir[0] != '\0' &&
+        asprintf(&database_dir, "%s/%s", cwd, database_dir) == -1)
+      exit(1);
+    free(cwd);
+  }
+
   if (chdir("/") != 0)
       exit(1);
   umask(0);
@@ -299,12 +1539,33 @@ if (!foreground) {
   close(1);
   close(2);
 
-  if (tcp_daemon)
-    daemon_open_sockets();
+  if (hotplug)
+    daemon_open_uevent();
+
+  if (tcp_daemon) {
+    if (!no_tcp)
+      daemon_open_sockets(portnum, PROTO_HDDTEMP);
+    if (unix_path)
+      daemon_open_unix_socket(unix_path, unix_mode);
+    if (metrics_port > 0)
+      daemon_open_sockets(metrics_port, PROTO_HTTP);
+  }
 
   if (syslog_interval > 0)
     openlog("hddtemp", LOG_PID, LOG_DAEMON);
 
+  /* SIGHUP is read from a signalfd, no thread may catch it */
+  sigemptyset(&hup);
+  sigaddset(&hup, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &hup, NULL);
+  daemon_open_reload(&hup);
+
+  /* threads do not survive fork(), so start the workers only now */
+  disks = ldisks;
+  for(ndisks = 0, dsk = disks; dsk; dsk = dsk->next)
+    ndisks++;
+  poller = pool_create((ndisks < poll_workers && !hotplug) ? ndisks : poll_workers);
+
   /* redirect signals */
   for(i = 0; i <= _NSIG; i++) {
     switch(i) {
@@ -315,83 +1576,114 @@ if (!foreground) {
     case SIGPIPE:
       signal(SIGPIPE, SIG_IGN);
       break;
+    case SIGHUP:  /* blocked, see above */
+      break;
     default:
       signal(i, daemon_stop);
       break;
     }
   }
 
-  /* timers initialization */
-  next_time = time(NULL);
-  for(dsk = ldisks; dsk; dsk = dsk->next) {
-    time(&dsk->last_time);
-    time_st = gmtime(&dsk->last_time);
-    time_st->tm_year -= 1;
-    dsk->last_time = mktime(time_st);
-  }
+  /* first readings are taken before serving anybody */
+  n = ndisks;
+  due_disks = (struct disk **) malloc(sizeof(struct disk *) * (n ? n : 1));
+  if (due_disks == NULL)
+    exit(1);
+  for(i = 0, dsk = disks; dsk; dsk = dsk->next)
+    due_disks[i++] = dsk;
+  daemon_update(due_disks, n);
+
+  if (tcp_daemon)
+    snapshot_publish(daemon_render(disks));
+  if (syslog_interval > 0)
+    daemon_syslog(disks);
+
+  wheel_init();
+  daemon_start_timers(wheel_now());
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sampler_wake, &attr);
+  pthread_condattr_destroy(&attr);
 
-  /* initialize file descriptors and compute maxfd */
-  FD_ZERO(&deffds);
-  maxfd = -1;
+  /* the sampler must not catch the signals meant for the main loop */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  ret = pthread_create(&sampler, NULL, daemon_sampler, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if (ret != 0)
+    exit(1);
+
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd == -1)
+    exit(1);
+  spare_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+  listeners = (struct conn *) calloc(sks_serv_num ? sks_serv_num : 1, sizeof(struct conn));
+  if (listeners == NULL)
+    exit(1);
 
   for (i = 0 ; i < sks_serv_num; i++) {
-    FD_SET(sks_serv[i], &deffds);
+    struct epoll_event ev;
+
+    c = &listeners[i];
+    c->prev = c->next = c;
+    c->fd = sks_serv[i];
+    c->proto = sks_proto[i];
+    c->listening = 1;
 
-    if (maxfd < sks_serv[i])
-      maxfd = sks_serv[i];
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) == -1)
+      exit(1);
   }
 
   /* start daemon */
   while(stop_daemon == 0) {
-    fd_set fds;
-    fds = deffds;
+    ret = epoll_wait(epfd, events, MAX_EVENTS, daemon_timeout());
+
+    if (ret == -1) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
 
-    if (syslog_interval > 0)
-    {
-      struct timeval tv;
-      time_t current_time;
+    for (i = 0; i < ret; i++) {
+      c = (struct conn *) events[i].data.ptr;
 
-      current_time = time(NULL);
-      if (next_time > current_time)
-        tv.tv_sec = next_time - current_time;
+      if (c->listening && c->proto == PROTO_UEVENT)
+        daemon_uevent(c);
+      else if (c->listening && (c->proto == PROTO_SIGNAL || c->proto == PROTO_WATCH))
+        daemon_reload_event(c);
+      else if (c->listening)
+        daemon_accept(c);
+      else if (events[i].events & EPOLLERR)
+        conn_close(c);
       else
-        tv.tv_sec = 0;
-      tv.tv_usec = 0;
-      ret = select(maxfd + 1, &fds, NULL, NULL, &tv);
+        conn_event(c);
     }
-    else
-      ret = select(maxfd + 1, &fds, NULL, NULL, NULL);
 
-    if (ret == -1)
-      break;
-    else if (ret == 0 && syslog_interval > 0) {
-      daemon_syslog(ldisks);
-      next_time = time(NULL) + syslog_interval;
-    }
-    else if (tcp_daemon) {
-      struct sockaddr_storage caddr;
-      socklen_t sz_caddr;
-      sz_caddr = sizeof(struct sockaddr_storage);
-
-      for (i = 0 ; i < sks_serv_num; i++) {
-        if (FD_ISSET(sks_serv[i], &fds))
-          break;
-      }
-
-      if (i == sks_serv_num)
-        continue;
+    daemon_expire();
+  }
 
-      if ((cfd = accept(sks_serv[i], (struct sockaddr *)&caddr, &sz_caddr)) == -1)
-        continue;
+  while (idle_head.next != &idle_head)
+    conn_close(idle_head.next);
+  close(epfd);
+  free(listeners);
+  if (spare_fd != -1)
+    close(spare_fd);
 
-      daemon_send_msg(ldisks, cfd);
+  pthread_mutex_lock(&sampler_lock);
+  sampler_stop = 1;
+  pthread_cond_signal(&sampler_wake);
+  pthread_mutex_unlock(&sampler_lock);
+  pthread_join(sampler, NULL);
 
-      close(cfd);
-    }
-  }
+  daemon_close_sockets();
 
-  if (tcp_daemon)
-    daemon_close_sockets();
+  pool_destroy(poller);
+  snapshot_publish(NULL);
+  free(due_disks);
 
   if (syslog_interval > 0)
     closelog();
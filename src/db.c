@@ -16,6 +16,8 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _GNU_SOURCE
+
 // Include file generated by ./configure
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -37,35 +39,327 @@
 #include <regex.h>
 #include <string.h>
 #include <errno.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
 
 // Application specific includes
 #include "db.h"
+#include "acmatch.h"
+#include "buffer.h"
+
+#define DB_IMAGE_MAGIC         "HDDTEMPD"
+#define DB_IMAGE_VERSION       3
+
+/* Layout of a compiled database, in the byte order of the host that
+   compiled it.  Every section starts on an 8 byte boundary. */
+struct db_image_header {
+  char          magic[8];
+  uint32_t      version;
+  uint32_t      checksum;         /* FNV-1a of everything after the header */
+  uint64_t      size;             /* of the whole image */
+  uint64_t      source_size;      /* text database it was compiled from */
+  int64_t       source_mtime;
+  int64_t       source_mtime_nsec;
+  uint32_t      ndropins;         /* and its drop-in files */
+  uint32_t      dropins;          /* fingerprint of their names, sizes and times */
+  uint32_t      nentries;
+  uint32_t      nnodes;
+  uint32_t      nalways;
+  uint32_t      strings_size;
+  uint64_t      entries_off;      /* struct db_image_entry[nentries] */
+  uint64_t      nodes_off;        /* struct ac_node[nnodes] */
+  uint64_t      out_next_off;     /* int32_t[nentries] */
+  uint64_t      always_off;       /* int32_t[nalways] */
+  uint64_t      strings_off;      /* NUL terminated strings */
+};
+
+struct db_image_entry {
+  uint32_t      regexp;           /* offsets in the strings */
+  uint32_t      description;
+  int16_t       attribute_id;
+  int16_t       attribute_id2;
+  uint8_t       unit;
+  uint8_t       pad[3];
+};
+
+/* The regular expressions of a text database are compiled as they are
+   loaded.  Each one is indexed by the longest literal that any match
+   must contain, and a lookup runs them only when that literal occurs in
+   the model, in database order.  Those without such a literal are
+   always tried.
+
+   A database compiled with --compile-db is mapped as is instead: its
+   entries, strings and index are used in place, and its regexps are
+   only compiled the first time they are tried.
+
+   Lookups collect their candidates in arrays allocated with the
+   database, one lookup at a time. */
+struct database {
+  struct harddrive_entry *      list;
+  struct harddrive_entry **     last;
+  struct harddrive_entry **     entries;
+  regex_t *                     regex;
+  unsigned char *               compiled;     /* image: regexps compiled so far */
+  int                           count, size;
+  int32_t *                     always;
+  int                           nalways;
+  struct acmatch                index;
+
+  unsigned int *                seen;         /* stamp of the last lookup that saw each entry */
+  unsigned int                  stamp;
+  int *                         ids;
+
+  void *                        map;
+  size_t                        map_size;
+  const struct db_image_entry * image_entries;
+  const char *                  strings;
+};
+
+static struct database *        db = NULL;    /* the one in use */
+static pthread_mutex_t          db_lookup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* entry i, from the list or the image */
+static void db_get(const struct database *d, int i, struct harddrive_entry *entry) {
+  const struct db_image_entry *e;
+
+  if(d->map == NULL) {
+    memcpy(entry, d->entries[i], sizeof(struct harddrive_entry));
+    return;
+  }
 
-#define MAX_LINE_LEN           1024
+  e = &d->image_entries[i];
+  entry->regexp        = (char *) d->strings + e->regexp;
+  entry->description   = (char *) d->strings + e->description;
+  entry->attribute_id  = e->attribute_id;
+  entry->attribute_id2 = e->attribute_id2;
+  entry->unit          = e->unit;
+  entry->next          = NULL;
+}
 
-static struct harddrive_entry   *supported_drives = NULL;
-struct harddrive_entry   **last_entry = &supported_drives;
+/* regexp i, with db_lookup_lock held */
+static regex_t *db_get_regex(struct database *d, int i) {
+  struct harddrive_entry entry;
 
-struct harddrive_entry *is_a_supported_drive(const char* model) {
-  struct harddrive_entry *p;
+  if(d->compiled && !d->compiled[i]) {
+    db_get(d, i, &entry);
+    if(regcomp(&d->regex[i], entry.regexp, REG_EXTENDED | REG_NOSUB))
+      exit(-2);
+    d->compiled[i] = 1;
+  }
 
-  if(model == NULL)
-    return NULL;
+  return &d->regex[i];
+}
+
+/* the lookup scratch arrays, once the database has all its entries */
+static void db_alloc_lookup(struct database *d) {
+  d->seen = (unsigned int *) calloc(d->count ? d->count : 1, sizeof(unsigned int));
+  d->ids = (int *) malloc((d->count ? d->count : 1) * sizeof(int));
+  if(d->seen == NULL || d->ids == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  d->stamp = 0;
+}
 
-  for(p = supported_drives; p; p = p->next) {
-    regex_t     preg;
-    regmatch_t  pmatch;
+struct db_candidates {
+  struct database  *d;
+  int              n;
+};
 
-    if(regcomp(&preg, p->regexp, REG_EXTENDED))
-      exit(-2);
+static void db_candidate(int id, void *arg) {
+  struct db_candidates *cand = (struct db_candidates *) arg;
+  struct database      *d = cand->d;
 
-    if(regexec(&preg, model, 1, &pmatch, 0) == 0)
-      return p;
+  if(d->seen[id] != d->stamp) {
+    d->seen[id] = d->stamp;
+    d->ids[cand->n++] = id;
   }
+}
 
-  return NULL;
+static int db_compare_ids(const void *a, const void *b) {
+  return *(const int *) a - *(const int *) b;
+}
+
+/* Look model up, filling entry with the first matching drive.  Returns
+   1 if there was one. */
+int is_a_supported_drive(const char* model, struct harddrive_entry *entry) {
+  struct db_candidates    cand;
+  struct database *       d = db;
+  int                     i, found = 0;
+
+  if(model == NULL || d == NULL || d->count == 0)
+    return 0;
+
+  pthread_mutex_lock(&db_lookup_lock);
+
+  /* a new stamp marks every entry unseen */
+  if(++d->stamp == 0) {
+    memset(d->seen, 0, d->count * sizeof(unsigned int));
+    d->stamp = 1;
+  }
+  cand.d = d;
+  cand.n = 0;
+
+  for(i = 0; i < d->nalways; i++)
+    db_candidate(d->always[i], &cand);
+  ac_scan(&d->index, model, db_candidate, &cand);
+  qsort(d->ids, cand.n, sizeof(int), db_compare_ids);
+
+  for(i = 0; i < cand.n; i++) {
+    if(regexec(db_get_regex(d, d->ids[i]), model, 0, NULL, 0) == 0) {
+      db_get(d, d->ids[i], entry);
+      found = 1;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&db_lookup_lock);
+
+  return found;
+}
+
+/* Entry i of the database in use, in lookup order.  Returns 0 past the
+   last one. */
+int get_database_entry(int i, struct harddrive_entry *entry) {
+  if(db == NULL || i < 0 || i >= db->count)
+    return 0;
+
+  db_get(db, i, entry);
+  return 1;
+}
+
+/* Longest literal that every match of the extended regular expression
+   regexp contains, copied to lit, using run as scratch space (both as
+   long as regexp).  Only the top level is looked at: groups and bracket
+   expressions end a literal, and a top level alternative means there
+   is none.  Returns its length. */
+static int db_literal(const char *regexp, char *lit, char *run) {
+  const char  *p;
+  int         depth = 0, len = 0, best = 0;
+
+  for(p = regexp; *p; p++) {
+    int c = *p;
+    int literal = 0;
+
+    switch(c) {
+      case '\\':
+        if(p[1] == '\0')
+          return 0;
+        c = *++p;
+        /* GNU escapes such as \w or \< aren't literals */
+        literal = !(isalnum(c) || c == '<' || c == '>' || c == '`' || c == '\'');
+        break;
+      case '[':
+        p++;
+        if(*p == '^')
+          p++;
+        if(*p == ']')
+          p++;
+        for(; *p && *p != ']'; p++) {
+          /* [:class:], [.coll.] and [=equiv=] */
+          if(*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+            char        end = p[1];
+            const char  *q = p + 2;
+
+            while(*q && !(q[0] == end && q[1] == ']'))
+              q++;
+            if(*q == '\0')
+              return 0;
+            p = q + 1;
+          }
+        }
+        if(*p == '\0')
+          return 0;
+        break;
+      case '(':
+        depth++;
+        break;
+      case ')':
+        depth--;
+        break;
+      case '|':
+        if(depth == 0)
+          return 0;
+        break;
+      case '*':
+      case '?':
+      case '{':
+        /* the previous character may be absent */
+        if(depth == 0 && len > 0)
+          len--;
+        if(c == '{')
+          while(p[1] && *p != '}')
+            p++;
+        break;
+      case '.':
+      case '+':
+      case '^':
+      case '$':
+        break;
+      default:
+        literal = 1;
+        break;
+    }
+
+    if(literal && depth == 0) {
+      run[len++] = c;
+      continue;
+    }
+
+    if(depth == 0 || c == '(') {
+      if(len > best) {
+        memcpy(lit, run, len);
+        best = len;
+      }
+      len = 0;
+    }
+  }
+
+  if(len > best) {
+    memcpy(lit, run, len);
+    best = len;
+  }
+
+  return best;
 }
 
+/* Index the regular expressions once the whole database is loaded. */
+static void db_build_index(struct database *d) {
+  char    *lit, *run;
+  size_t  max = 0;
+  int     i, len;
+
+  for(i = 0; i < d->count; i++)
+    if(strlen(d->entries[i]->regexp) > max)
+      max = strlen(d->entries[i]->regexp);
+
+  ac_init(&d->index, d->count);
+  d->always = (int32_t *) malloc((d->count ? d->count : 1) * sizeof(int32_t));
+  lit = (char *) malloc(max + 1);
+  run = (char *) malloc(max + 1);
+  if(d->always == NULL || lit == NULL || run == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  for(i = 0; i < d->count; i++) {
+    len = db_literal(d->entries[i]->regexp, lit, run);
+    if(len > 0)
+      ac_add(&d->index, lit, len, i);
+    else
+      d->always[d->nalways++] = i;
+  }
+
+  ac_build(&d->index);
+  free(run);
+  free(lit);
+
+  db_alloc_lookup(d);
+}
 
 static const char *extract_string(char **string) {
   char *str;
@@ -93,12 +387,19 @@ static const char *extract_string(char **string) {
 
 void display_supported_drives() {
   unsigned char           *tabs, *line;
-  struct harddrive_entry  *p;
-  int                     max, len;
+  struct harddrive_entry  entry;
+  struct database         empty, *d;
+  int                     max, len, i;
+
+  if((d = db) == NULL) {
+    memset(&empty, 0, sizeof(empty));
+    d = &empty;
+  }
 
   max = 0;
-  for(p = supported_drives; p; p = p->next) {
-    len = strlen(p->regexp);
+  for(i = 0; i < d->count; i++) {
+    db_get(d, i, &entry);
+    len = strlen(entry.regexp);
     if(len > max)
       max = len;
   }
@@ -116,19 +417,20 @@ void display_supported_drives() {
          "Regexp%s| Value | Description\n"
          "------%s---------------------\n"), tabs, line);
 
-  for(p = supported_drives; p; p = p->next) {
-    len = strlen(p->regexp);
+  for(i = 0; i < d->count; i++) {
+    db_get(d, i, &entry);
+    len = strlen(entry.regexp);
     printf(_("%s%s| %5d | %s\n"),
-           p->regexp,
+           entry.regexp,
            tabs+(len/8),
-           p->attribute_id,
-           p->description);
+           entry.attribute_id,
+           entry.description);
   }
   printf("\n");
 }
 
 
-static int parse_db_line(char *line) {
+static int parse_db_line(struct database *d, char *line) {
   const char             *regexp, 
                          *description;
   struct harddrive_entry *new_entry;
@@ -186,6 +488,19 @@ static int parse_db_line(char *line) {
   description = line; 
   *p = '\0';
 
+  /* compile the regexp once and for all */
+  if(d->count == d->size) {
+    d->size = d->size ? 2 * d->size : 64;
+    d->entries = (struct harddrive_entry **) realloc(d->entries, d->size * sizeof(struct harddrive_entry *));
+    d->regex = (regex_t *) realloc(d->regex, d->size * sizeof(regex_t));
+    if(d->entries == NULL || d->regex == NULL) {
+      perror("realloc");
+      exit(-1);
+    }
+  }
+  if(regcomp(&d->regex[d->count], regexp, REG_EXTENDED | REG_NOSUB))
+    return 1;
+
   /* add new entry to the list */
   new_entry = (struct harddrive_entry*) malloc(sizeof(struct harddrive_entry));
   if(new_entry == NULL) {
@@ -199,16 +514,20 @@ static int parse_db_line(char *line) {
   new_entry->attribute_id2 = 0;
   new_entry->unit         = unit;
   new_entry->next         = NULL;
-  *last_entry = new_entry;
-  last_entry = &(new_entry->next);
+  *d->last = new_entry;
+  d->last = &(new_entry->next);
+  d->entries[d->count++] = new_entry;
 
   return 0;
 }
 
-void free_database(void) {
+void release_database(struct database *d) {
   struct harddrive_entry   *p;
 
-  p = supported_drives;
+  if(d == NULL)
+    return;
+
+  p = d->list;
 
   while( p ) {
     struct harddrive_entry   *q;
@@ -223,49 +542,464 @@ void free_database(void) {
     p = p->next;
     free(q);
   }
+
+  while(d->count > 0) {
+    d->count--;
+    if(d->compiled == NULL || d->compiled[d->count])
+      regfree(&d->regex[d->count]);
+  }
+  free(d->regex);
+  free(d->compiled);
+  free(d->entries);
+  free(d->seen);
+  free(d->ids);
+
+  /* the index of an image is part of the mapping */
+  if(d->map)
+    munmap(d->map, d->map_size);
+  else {
+    free(d->always);
+    ac_free(&d->index);
+  }
+
+  free(d);
+}
+
+void free_database(void) {
+  release_database(swap_database(NULL));
+}
+
+static struct database *db_new(void) {
+  struct database *d;
+
+  d = (struct database *) calloc(1, sizeof(struct database));
+  if(d == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  d->last = &d->list;
+
+  return d;
 }
 
-void load_database(const char* filename) {
-  char  buff[MAX_LINE_LEN];
-  char  *p, *s, *e, *ee;
-  int   fd;
-  int   n, rest, numline;
+static uint32_t db_fnv1a(uint32_t h, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *) data;
+
+  while(len--) {
+    h ^= *p++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
 
-  errno = 0;
-  fd = open(filename, O_RDONLY);
-  if(fd == -1) {
+/* Append the entries of a text database.  Returns the number of
+   syntax errors, each reported, or -1 if it can't be read. */
+static int load_text_database(struct database *d, const char* filename) {
+  FILE *   f;
+  char *   line = NULL;
+  size_t   size = 0;
+  ssize_t  n;
+  int      numline = 0, errors = 0;
+
+  f = fopen(filename, "re");
+  if(f == NULL) {
     fprintf(stderr, _("hddtemp: can't open %1$s: %2$s\n"), filename, strerror(errno));
-    exit(2);
+    return -1;
   }
 
-  numline = 0;
-  rest = MAX_LINE_LEN;
-  p = buff;
-  while((n = read(fd, p, rest)) > 0) {
-    s = buff;
-    ee = p + n;
-    while((e = memchr(s, '\n', ee-s))) {
-      *e = '\0';
-      numline++;
-      if(parse_db_line(s)) {
-        fprintf(stderr, _("ERROR: syntax error at line %1$d in %2$s\n"), numline, filename);
-        exit(2);
-      }
-      s = e+1;
+  while((n = getline(&line, &size, f)) != -1) {
+    if(n > 0 && line[n - 1] == '\n')
+      line[n - 1] = '\0';
+    numline++;
+    if(parse_db_line(d, line)) {
+      fprintf(stderr, _("ERROR: syntax error at line %1$d in %2$s\n"), numline, filename);
+      errors++;
     }
+  }
 
-    if(s == buff) {
-      fprintf(stderr, _("  ERROR: line exceed %1$d characters in %2$s.\n"), MAX_LINE_LEN, filename);
-      close(fd);
-      exit(2);
+  if(ferror(f)) {
+    fprintf(stderr, _("hddtemp: can't read %1$s: %2$s\n"), filename, strerror(errno));
+    errors = -1;
+  }
+
+  free(line);
+  fclose(f);
+
+  return errors;
+}
+
+static int db_dropin_filter(const struct dirent *de) {
+  size_t len = strlen(de->d_name);
+
+  return de->d_name[0] != '.' && len > 3 && strcmp(de->d_name + len - 3, ".db") == 0;
+}
+
+/* The *.db files of the drop-in directory dir, in name order, and a
+   fingerprint of their names, sizes and modification times.  A missing
+   directory has none. */
+static int db_dropins(const char *dir, char ***files, uint32_t *fingerprint) {
+  struct dirent **  list;
+  struct stat       st;
+  int               i, n;
+
+  *files = NULL;
+  *fingerprint = 2166136261U;
+  if(dir == NULL || *dir == '\0' || (n = scandir(dir, &list, db_dropin_filter, alphasort)) == -1)
+    return 0;
+
+  *files = (char **) malloc((n ? n : 1) * sizeof(char *));
+  if(*files == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  for(i = 0; i < n; i++) {
+    if(asprintf(&(*files)[i], "%s/%s", dir, list[i]->d_name) == -1) {
+      perror("asprintf");
+      exit(-1);
     }
 
-    memmove(buff, s, ee-s); /* because memory can overlap */
+    memset(&st, 0, sizeof(st));
+    stat((*files)[i], &st);
+    *fingerprint = db_fnv1a(*fingerprint, list[i]->d_name, strlen(list[i]->d_name) + 1);
+    *fingerprint = db_fnv1a(*fingerprint, &st.st_size, sizeof(st.st_size));
+    *fingerprint = db_fnv1a(*fingerprint, &st.st_mtim, sizeof(st.st_mtim));
+    free(list[i]);
+  }
+  free(list);
+
+  return n;
+}
+
+static void db_free_dropins(char **files, int n) {
+  while(n > 0)
+    free(files[--n]);
+  free(files);
+}
+
+/* The drop-in files, the last one first, then the base database: the
+   first matching entry wins, so a drop-in file overrides the base
+   database and the files sorted before it.  Returns the number of
+   errors. */
+static int load_text_databases(struct database *d, const char *filename, char **files, int n) {
+  int errors = 0, ret;
+
+  while(n > 0) {
+    ret = load_text_database(d, files[--n]);
+    errors += (ret == -1) ? 1 : ret;
+  }
+
+  ret = load_text_database(d, filename);
+  errors += (ret == -1) ? 1 : ret;
+
+  db_build_index(d);
+
+  return errors;
+}
+
+static uint32_t db_image_checksum(const unsigned char *data, size_t len) {
+  return db_fnv1a(2166136261U, data, len);
+}
+
+static int db_image_range(const struct db_image_header *h, uint64_t off, uint64_t len) {
+  return off % 8 == 0 && off >= sizeof(*h) && off <= h->size && len <= h->size - off;
+}
 
-    rest = MAX_LINE_LEN - (ee-s);
-    p = buff + (ee-s);
+/* Map a database image.  source, if given, is the text database it has
+   to be compiled from, with the drop-in files of the given fingerprint.
+   Returns 1 if the image is now in use, 0 if path isn't an image or
+   can't be used. */
+static int db_map_image(struct database *d, const char *path, const struct stat *source,
+                        int ndropins, uint32_t dropins) {
+  const struct db_image_header * h;
+  const int32_t *                 ids;
+  struct stat                     st;
+  void *                          map;
+  int                             fd;
+  uint32_t                        i;
+
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    return 0;
+
+  if(fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(*h)) {
+    close(fd);
+    return 0;
   }
 
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
   close(fd);
+  if(map == MAP_FAILED)
+    return 0;
+
+  h = (const struct db_image_header *) map;
+  if(memcmp(h->magic, DB_IMAGE_MAGIC, sizeof(h->magic)) != 0) {
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  if(source && (h->version != DB_IMAGE_VERSION ||
+      h->source_size != (uint64_t) source->st_size ||
+      h->source_mtime != (int64_t) source->st_mtim.tv_sec ||
+      h->source_mtime_nsec != (int64_t) source->st_mtim.tv_nsec ||
+      h->ndropins != (uint32_t) ndropins || h->dropins != dropins)) {
+    fprintf(stderr, _("hddtemp: %s is out of date, ignored\n"), path);
+    munmap(map, st.st_size);
+    return 0;
+  }
+
+  if(h->version != DB_IMAGE_VERSION || h->size != (uint64_t) st.st_size ||
+     !db_image_range(h, h->entries_off, (uint64_t) h->nentries * sizeof(struct db_image_entry)) ||
+     !db_image_range(h, h->nodes_off, (uint64_t) h->nnodes * sizeof(struct ac_node)) ||
+     !db_image_range(h, h->out_next_off, (uint64_t) h->nentries * sizeof(int32_t)) ||
+     !db_image_range(h, h->always_off, (uint64_t) h->nalways * sizeof(int32_t)) ||
+     !db_image_range(h, h->strings_off, h->strings_size) ||
+     h->nnodes == 0 || h->strings_size == 0 ||
+     ((const char *) map)[h->strings_off + h->strings_size - 1] != '\0' ||
+     h->checksum != db_image_checksum((const unsigned char *) map + sizeof(*h), st.st_size - sizeof(*h)))
+    goto invalid;
+
+  /* the index is used as is, make sure it stays within the image */
+  d->image_entries = (const struct db_image_entry *) ((const char *) map + h->entries_off);
+  for(i = 0; i < h->nentries; i++)
+    if(d->image_entries[i].regexp >= h->strings_size || d->image_entries[i].description >= h->strings_size)
+      goto invalid;
+
+  d->index.nodes = (struct ac_node *) ((const char *) map + h->nodes_off);
+  for(i = 0; i < h->nnodes; i++) {
+    const struct ac_node *n = &d->index.nodes[i];
+
+    if(n->child < -1 || n->child >= (int32_t) h->nnodes ||
+       n->sibling < -1 || n->sibling >= (int32_t) h->nnodes ||
+       n->dict < -1 || n->dict >= (int32_t) h->nnodes ||
+       n->fail < 0 || n->fail >= (int32_t) h->nnodes ||
+       n->out < -1 || n->out >= (int32_t) h->nentries)
+      goto invalid;
+  }
+
+  ids = (const int32_t *) ((const char *) map + h->out_next_off);
+  for(i = 0; i < h->nentries; i++)
+    if(ids[i] < -1 || ids[i] >= (int32_t) h->nentries)
+      goto invalid;
+
+  ids = (const int32_t *) ((const char *) map + h->always_off);
+  for(i = 0; i < h->nalways; i++)
+    if(ids[i] < 0 || ids[i] >= (int32_t) h->nentries)
+      goto invalid;
+
+  /* and that no chain of links loops, lookups would never end */
+  d->index.out_next = (int32_t *) ((const char *) map + h->out_next_off);
+  d->index.nnodes = h->nnodes;
+  d->index.nids = h->nentries;
+  if(ac_check(&d->index) == -1)
+    goto invalid;
+
+  d->regex = (regex_t *) malloc((h->nentries ? h->nentries : 1) * sizeof(regex_t));
+  d->compiled = (unsigned char *) calloc(h->nentries ? h->nentries : 1, 1);
+  if(d->regex == NULL || d->compiled == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  d->map = map;
+  d->map_size = st.st_size;
+  d->strings = (const char *) map + h->strings_off;
+  d->count = h->nentries;
+  d->always = (int32_t *) ((const char *) map + h->always_off);
+  d->nalways = h->nalways;
+  db_alloc_lookup(d);
+
+  return 1;
+
+ invalid:
+  fprintf(stderr, _("hddtemp: %s: invalid database image, ignored\n"), path);
+  d->image_entries = NULL;
+  memset(&d->index, 0, sizeof(d->index));
+  munmap(map, st.st_size);
+  return 0;
+}
+
+static char *db_image_path(const char *filename) {
+  char *path;
+
+  if(asprintf(&path, "%s%s", filename, DB_IMAGE_SUFFIX) == -1) {
+    perror("asprintf");
+    exit(-1);
+  }
+
+  return path;
+}
+
+/* Load a database, from filename, which is a text database or an image,
+   and the *.db files of the drop-in directory dir.  The image compiled
+   from the text databases, next to the main one, is used instead of
+   them when it is up to date.  Returns NULL, after reporting every
+   error, if they can't be loaded. */
+struct database *read_database(const char* filename, const char *dir) {
+  struct database *  d;
+  struct stat        st;
+  char **            files;
+  char *             image;
+  uint32_t           fingerprint;
+  int                n, mapped;
+
+  /* an image given as is already holds its drop-in files */
+  d = db_new();
+  if(db_map_image(d, filename, NULL, 0, 0))
+    return d;
+
+  n = db_dropins(dir, &files, &fingerprint);
+
+  if(stat(filename, &st) == 0) {
+    image = db_image_path(filename);
+    mapped = db_map_image(d, image, &st, n, fingerprint);
+    free(image);
+    if(mapped) {
+      db_free_dropins(files, n);
+      return d;
+    }
+  }
+
+  if(load_text_databases(d, filename, files, n) > 0) {
+    release_database(d);
+    d = NULL;
+  }
+
+  db_free_dropins(files, n);
+
+  return d;
+}
+
+/* Make d the database lookups use.  Returns the previous one, still
+   referenced by the entries it returned until it is released. */
+struct database *swap_database(struct database *d) {
+  struct database *old = db;
+
+  db = d;
+  return old;
+}
+
+void load_database(const char* filename, const char *dir) {
+  struct database *d;
+
+  d = read_database(filename, dir);
+  if(d == NULL)
+    exit(2);
+
+  release_database(swap_database(d));
+}
+
+static void db_image_pad(struct buffer *buf) {
+  static const char zero[8];
+
+  buffer_append(buf, zero, (8 - buf->len % 8) % 8);
 }
 
+/* Compile the text database filename and the drop-in files of dir into
+   an image, written to image or next to filename.  Returns 0, or -1
+   with errno set, or with errno 0 once the errors found in the text
+   databases are reported. */
+int compile_database(const char *filename, const char *dir, const char *image) {
+  struct db_image_header  h;
+  struct db_image_entry   e;
+  struct buffer           buf, strings;
+  struct database *       d;
+  struct stat             st;
+  char **                 files;
+  char *                  path;
+  char *                  tmp;
+  uint32_t                fingerprint;
+  int                     fd, i, n, ret = -1;
+
+  if(stat(filename, &st) == -1)
+    return -1;
+
+  d = db_new();
+  n = db_dropins(dir, &files, &fingerprint);
+  if(load_text_databases(d, filename, files, n) > 0) {
+    db_free_dropins(files, n);
+    release_database(d);
+    errno = 0;
+    return -1;
+  }
+  db_free_dropins(files, n);
+
+  path = image ? strdup(image) : db_image_path(filename);
+  if(path == NULL || asprintf(&tmp, "%s.tmp", path) == -1) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, DB_IMAGE_MAGIC, sizeof(h.magic));
+  h.version = DB_IMAGE_VERSION;
+  h.source_size = st.st_size;
+  h.source_mtime = st.st_mtim.tv_sec;
+  h.source_mtime_nsec = st.st_mtim.tv_nsec;
+  h.ndropins = n;
+  h.dropins = fingerprint;
+  h.nentries = d->count;
+  h.nnodes = d->index.nnodes;
+  h.nalways = d->nalways;
+
+  buffer_init(&buf);
+  buffer_init(&strings);
+  buffer_append(&buf, &h, sizeof(h));
+
+  h.entries_off = buf.len;
+  for(i = 0; i < d->count; i++) {
+    memset(&e, 0, sizeof(e));
+    e.regexp = strings.len;
+    buffer_append(&strings, d->entries[i]->regexp, strlen(d->entries[i]->regexp) + 1);
+    e.description = strings.len;
+    buffer_append(&strings, d->entries[i]->description, strlen(d->entries[i]->description) + 1);
+    e.attribute_id = d->entries[i]->attribute_id;
+    e.attribute_id2 = d->entries[i]->attribute_id2;
+    e.unit = d->entries[i]->unit;
+    buffer_append(&buf, &e, sizeof(e));
+  }
+  db_image_pad(&buf);
+
+  h.nodes_off = buf.len;
+  buffer_append(&buf, d->index.nodes, d->index.nnodes * sizeof(struct ac_node));
+  db_image_pad(&buf);
+
+  h.out_next_off = buf.len;
+  buffer_append(&buf, d->index.out_next, d->count * sizeof(int32_t));
+  db_image_pad(&buf);
+
+  h.always_off = buf.len;
+  buffer_append(&buf, d->always, d->nalways * sizeof(int32_t));
+  db_image_pad(&buf);
+
+  h.strings_off = buf.len;
+  h.strings_size = strings.len;
+  buffer_append(&buf, strings.data, strings.len);
+
+  h.size = buf.len;
+  h.checksum = db_image_checksum((unsigned char *) buf.data + sizeof(h), buf.len - sizeof(h));
+  memcpy(buf.data, &h, sizeof(h));
+
+  /* replaced in one go, for the hddtemp instances reading it */
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd != -1) {
+    if(write(fd, buf.data, buf.len) == (ssize_t) buf.len && fsync(fd) == 0 &&
+       close(fd) == 0 && rename(tmp, path) == 0)
+      ret = 0;
+    else {
+      int err = errno;
+
+      close(fd);
+      unlink(tmp);
+      errno = err;
+    }
+  }
+
+  buffer_free(&strings);
+  buffer_free(&buf);
+  free(tmp);
+  free(path);
+  release_database(d);
+
+  return ret;
+}
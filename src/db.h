@@ -23,6 +23,14 @@
 #define DEFAULT_DATABASE_PATH  "/usr/share/misc/hddtemp.db"
 #endif
 
+#ifndef DEFAULT_DATABASE_DIR
+#define DEFAULT_DATABASE_DIR   "/etc/hddtemp.d"
+#endif
+
+#define DB_IMAGE_SUFFIX        ".bin"
+
+struct database;
+
 struct harddrive_entry {
   char                   *regexp;
   short int              attribute_id;
@@ -32,9 +40,14 @@ struct harddrive_entry {
   struct harddrive_entry *next;
 };
 
-struct harddrive_entry *is_a_supported_drive(const char* model);
+int is_a_supported_drive(const char* model, struct harddrive_entry *entry);
+int get_database_entry(int i, struct harddrive_entry *entry);
 void display_supported_drives();
-void load_database(const char* filename);
+void load_database(const char* filename, const char *dir);
+struct database *read_database(const char* filename, const char *dir);
+struct database *swap_database(struct database *db);
+void release_database(struct database *db);
+int compile_database(const char *filename, const char *dir, const char *image);
 void free_database(void);
 
 #endif
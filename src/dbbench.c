@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Drive database benchmark: loads a database, looks a corpus of model
+   strings up in it and reports the load time, the lookup latencies and
+   the allocations of both.  The results can be saved as a baseline and
+   later runs compared with it.
+
+   Build it with "make dbbench". */
+
+#define _GNU_SOURCE
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+
+// Application specific includes
+#include "db.h"
+#include "buffer.h"
+
+#define LOAD_RUNS              20
+#define LOOKUP_ROUNDS          10
+#define GENERATED_MODELS       10000
+#define TOLERANCE              25      /* % slower than the baseline that is a regression */
+
+/*******************************************************
+ * Allocations, counted by interposing on the allocator
+ *******************************************************/
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int            counting = 0;
+static unsigned long  alloc_count = 0, alloc_bytes = 0;
+
+void *malloc(size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += size;
+  }
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += nmemb * size;
+  }
+  return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  if(counting) {
+    alloc_count++;
+    alloc_bytes += size;
+  }
+  return __libc_realloc(ptr, size);
+}
+
+#define HAVE_ALLOC_COUNT       1
+#else
+static int            counting = 0;
+static unsigned long  alloc_count = 0, alloc_bytes = 0;
+#define HAVE_ALLOC_COUNT       0
+#endif
+
+static void count_start(void) {
+  alloc_count = alloc_bytes = 0;
+  counting = 1;
+}
+
+static void count_stop(void) {
+  counting = 0;
+}
+
+/*******************************************************
+ * Model strings generated from the regexps
+ *******************************************************/
+
+static const char *gen_seq(const char *p, struct buffer *out, int depth);
+
+/* Skip the rest of a group after its first alternative. */
+static const char *gen_skip(const char *p, int depth) {
+  int level = 0;
+
+  for(; *p; p++) {
+    if(*p == '\\' && p[1])
+      p++;
+    else if(*p == '[') {
+      p++;
+      if(*p == '^')
+        p++;
+      if(*p == ']')
+        p++;
+      while(*p && *p != ']')
+        p++;
+      if(*p == '\0')
+        break;
+    }
+    else if(*p == '(')
+      level++;
+    else if(*p == ')') {
+      if(level == 0 && depth > 0)
+        break;
+      level--;
+    }
+  }
+
+  return p;
+}
+
+/* A character of the bracket expression p points after the '[' of. */
+static const char *gen_bracket(const char *p, struct buffer *out) {
+  static const char *  preferred = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-abcdefghijklmnopqrstuvwxyz ";
+  unsigned char        set[256];
+  const char *         q;
+  int                  negate = 0, c, first = 1;
+
+  memset(set, 0, sizeof(set));
+  if(*p == '^') {
+    negate = 1;
+    p++;
+  }
+
+  for(; *p && (*p != ']' || first); p++, first = 0) {
+    if(p[0] == '[' && p[1] == ':' && (q = strstr(p + 2, ":]")) != NULL) {
+      for(c = 1; c < 256; c++) {
+        if((strncmp(p + 2, "alpha", 5) == 0 && isalpha(c)) ||
+           (strncmp(p + 2, "digit", 5) == 0 && isdigit(c)) ||
+           (strncmp(p + 2, "alnum", 5) == 0 && isalnum(c)) ||
+           (strncmp(p + 2, "upper", 5) == 0 && isupper(c)) ||
+           (strncmp(p + 2, "lower", 5) == 0 && islower(c)) ||
+           (strncmp(p + 2, "space", 5) == 0 && isspace(c)) ||
+           (strncmp(p + 2, "blank", 5) == 0 && (c == ' ' || c == '\t')) ||
+           (strncmp(p + 2, "punct", 5) == 0 && ispunct(c)) ||
+           (strncmp(p + 2, "xdigit", 6) == 0 && isxdigit(c)))
+          set[c] = 1;
+      }
+      p = q + 1;
+    }
+    else if(p[1] == '-' && p[2] && p[2] != ']') {
+      for(c = (unsigned char) p[0]; c <= (unsigned char) p[2]; c++)
+        set[c] = 1;
+      p += 2;
+    }
+    else
+      set[(unsigned char) *p] = 1;
+  }
+
+  for(q = preferred; *q; q++)
+    if(set[(unsigned char) *q] != negate)
+      break;
+  if(*q)
+    buffer_append(out, q, 1);
+
+  return *p ? p : p - 1;
+}
+
+/* The first alternative of a sequence, up to the ')' ending its group,
+   with the fewest repetitions of each atom. */
+static const char *gen_seq(const char *p, struct buffer *out, int depth) {
+  size_t  atom = out->len;
+  char    c;
+  int     n;
+
+  for(; *p; p++) {
+    switch(*p) {
+      case ')':
+        if(depth > 0)
+          return p;
+        break;
+      case '|':
+        return gen_skip(p, depth);
+      case '^':
+      case '$':
+        break;
+      case '*':
+      case '?':
+        out->len = atom;
+        break;
+      case '+':
+        break;
+      case '{':
+        n = atoi(p + 1);
+        if(n == 0)
+          out->len = atom;
+        else {
+          size_t len = out->len - atom;
+
+          /* out->data may move while it grows */
+          while(--n > 0) {
+            buffer_append(out, "", len);
+            memcpy(out->data + out->len - len, out->data + atom, len);
+          }
+        }
+        while(*p && *p != '}')
+          p++;
+        if(*p == '\0')
+          return p;
+        break;
+      case '(':
+        atom = out->len;
+        p = gen_seq(p + 1, out, depth + 1);
+        if(*p == '\0')
+          return p;
+        break;
+      case '[':
+        atom = out->len;
+        p = gen_bracket(p + 1, out);
+        break;
+      case '.':
+        atom = out->len;
+        buffer_append(out, "X", 1);
+        break;
+      case '\\':
+        if(p[1] == '\0')
+          return p;
+        atom = out->len;
+        c = *++p;
+        buffer_append(out, isalnum((unsigned char) c) ? "A" : &c, 1);
+        break;
+      default:
+        atom = out->len;
+        buffer_append(out, p, 1);
+        break;
+    }
+  }
+
+  return p;
+}
+
+/* n model strings: one generated from each entry that allows it in turn,
+   and every tenth one a model that isn't in the database. */
+static char **generate_models(int n, int *count) {
+  struct harddrive_entry  entry;
+  struct buffer           out;
+  regex_t                 re;
+  char **                 models;
+  int                     i, j, usable = 0;
+
+  models = (char **) malloc(n * sizeof(char *));
+  if(models == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  for(i = j = 0; i < n; j++) {
+    if(i % 10 == 9) {
+      if(asprintf(&models[i], "UNLISTED MODEL %d", i) == -1) {
+        perror("asprintf");
+        exit(1);
+      }
+      i++;
+      continue;
+    }
+
+    if(!get_database_entry(j, &entry)) {
+      if(usable == 0)
+        break;
+      j = -1;
+      usable = 0;
+      continue;
+    }
+
+    buffer_init(&out);
+    gen_seq(entry.regexp, &out, 0);
+    buffer_append(&out, "", 1);
+
+    /* keep only the strings the regexp really matches */
+    if(regcomp(&re, entry.regexp, REG_EXTENDED | REG_NOSUB) == 0) {
+      if(regexec(&re, out.data, 0, NULL, 0) == 0) {
+        models[i++] = strdup(out.data);
+        usable++;
+      }
+      regfree(&re);
+    }
+    buffer_free(&out);
+  }
+
+  *count = i;
+  return models;
+}
+
+static char **read_models(const char *path, int *count) {
+  FILE *   f;
+  char **  models = NULL;
+  char *   line = NULL;
+  size_t   size = 0;
+  ssize_t  len;
+  int      n = 0;
+
+  f = fopen(path, "r");
+  if(f == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  while((len = getline(&line, &size, f)) != -1) {
+    if(len > 0 && line[len - 1] == '\n')
+      line[--len] = '\0';
+    if(len == 0)
+      continue;
+
+    models = (char **) realloc(models, (n + 1) * sizeof(char *));
+    if(models == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+    models[n++] = strdup(line);
+  }
+
+  free(line);
+  fclose(f);
+
+  *count = n;
+  return models;
+}
+
+/*******************************************************
+ * Results and baseline
+ *******************************************************/
+
+struct result {
+  const char *  name;
+  double        value;
+  int           exact;        /* deterministic, any increase is a regression */
+};
+
+enum { R_LOAD_MS, R_LOAD_ALLOCS, R_LOAD_BYTES, R_LOOKUP_P50, R_LOOKUP_P90,
+       R_LOOKUP_P99, R_LOOKUP_MAX, R_LOOKUP_MEAN, R_LOOKUP_ALLOCS, R_MAX };
+
+static struct result results[R_MAX] = {
+  { "load_ms",            0, 0 },
+  { "load_allocs",        0, 1 },
+  { "load_bytes",         0, 1 },
+  { "lookup_p50_ns",      0, 0 },
+  { "lookup_p90_ns",      0, 0 },
+  { "lookup_p99_ns",      0, 0 },
+  { "lookup_max_ns",      0, 0 },
+  { "lookup_mean_ns",     0, 0 },
+  { "lookup_allocs",      0, 1 },
+};
+
+static void save_baseline(const char *path) {
+  FILE *  f;
+  int     i;
+
+  f = fopen(path, "w");
+  if(f == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  fprintf(f, "# dbbench baseline\n");
+  for(i = 0; i < R_MAX; i++)
+    if(HAVE_ALLOC_COUNT || !results[i].exact)
+      fprintf(f, "%s %.3f\n", results[i].name, results[i].value);
+
+  if(fclose(f) != 0) {
+    perror(path);
+    exit(1);
+  }
+}
+
+/* Returns the number of regressions.  lookup_max_ns is only reported,
+   it depends too much on the scheduler. */
+static int compare_baseline(const char *path, double tolerance) {
+  FILE *  f;
+  char    name[64];
+  char *  line = NULL;
+  size_t  size = 0;
+  double  base, limit;
+  int     i, regressions = 0;
+
+  f = fopen(path, "r");
+  if(f == NULL) {
+    perror(path);
+    exit(1);
+  }
+
+  printf("\n%-16s %14s %14s\n", "baseline", "was", "now");
+  while(getline(&line, &size, f) != -1) {
+    if(line[0] == '#' || sscanf(line, "%63s %lf", name, &base) != 2)
+      continue;
+
+    for(i = 0; i < R_MAX; i++)
+      if(strcmp(results[i].name, name) == 0)
+        break;
+    if(i == R_MAX || (results[i].exact && !HAVE_ALLOC_COUNT))
+      continue;
+
+    /* baselines are saved with 3 decimals */
+    limit = results[i].exact ? base + 0.0005 : base * (1 + tolerance / 100);
+    printf("%-16s %14.1f %14.1f", name, base, results[i].value);
+    if(i != R_LOOKUP_MAX && results[i].value > limit) {
+      printf("  REGRESSION");
+      regressions++;
+    }
+    printf("\n");
+  }
+
+  free(line);
+  fclose(f);
+
+  return regressions;
+}
+
+/*******************************************************
+ *******************************************************/
+
+static long long clock_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compare_ll(const void *a, const void *b) {
+  long long x = *(const long long *) a, y = *(const long long *) b;
+
+  return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+static double median(double *values, int n) {
+  qsort(values, n, sizeof(double), compare_double);
+  return values[n / 2];
+}
+
+static void usage(void) {
+  printf(" Usage: dbbench [OPTIONS] DATABASE [CORPUS]\n"
+         "\n"
+         "   Measure loading DATABASE and looking up the model strings of CORPUS\n"
+         "   (one per line) in it, or model strings generated from its regexps.\n"
+         "\n"
+         "  -b FILE  :  compare with the baseline saved in FILE, exit with 1 if\n"
+         "              a result is worse.\n"
+         "  -d DIR   :  also read the drop-in *.db files of DIR.\n"
+         "  -l #     :  load the database # times (%d by default).\n"
+         "  -n #     :  number of model strings to generate without CORPUS (%d by\n"
+         "              default).\n"
+         "  -r #     :  rounds of lookups over the corpus (%d by default).\n"
+         "  -s FILE  :  save the results as a baseline to FILE.\n"
+         "  -t PCT   :  how much slower than the baseline is a regression (%d%%\n"
+         "              by default).  Allocations may not increase at all.\n",
+         LOAD_RUNS, GENERATED_MODELS, LOOKUP_ROUNDS, TOLERANCE);
+}
+
+int main(int argc, char *argv[]) {
+  struct harddrive_entry  entry;
+  const char *            baseline = NULL, *save = NULL, *dir = NULL;
+  long long *             times, t;
+  char **                 models;
+  double                  tolerance = TOLERANCE, sum, *stats;
+  int                     load_runs = LOAD_RUNS, rounds = LOOKUP_ROUNDS, generated = GENERATED_MODELS;
+  int                     c, i, j, n, nentries, found, total;
+
+  while((c = getopt(argc, argv, "b:d:hl:n:r:s:t:")) != -1) {
+    switch(c) {
+      case 'b':
+        baseline = optarg;
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      case 'l':
+        load_runs = atoi(optarg);
+        break;
+      case 'n':
+        generated = atoi(optarg);
+        break;
+      case 'r':
+        rounds = atoi(optarg);
+        break;
+      case 's':
+        save = optarg;
+        break;
+      case 't':
+        tolerance = atof(optarg);
+        break;
+      case 'h':
+        usage();
+        exit(0);
+      default:
+        usage();
+        exit(1);
+    }
+  }
+
+  if(optind >= argc || argc - optind > 2 || load_runs < 1 || rounds < 1 || generated < 1) {
+    usage();
+    exit(1);
+  }
+
+  /* load: the median time, the allocations of the last one */
+  times = (long long *) malloc(load_runs * sizeof(long long));
+  if(times == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  for(i = 0; i < load_runs; i++) {
+    free_database();
+    count_start();
+    t = clock_ns();
+    load_database(argv[optind], dir);
+    times[i] = clock_ns() - t;
+    count_stop();
+  }
+  qsort(times, load_runs, sizeof(long long), compare_ll);
+  results[R_LOAD_MS].value = times[load_runs / 2] / 1e6;
+  results[R_LOAD_ALLOCS].value = alloc_count;
+  results[R_LOAD_BYTES].value = alloc_bytes;
+  free(times);
+
+  for(nentries = 0; get_database_entry(nentries, &entry); nentries++)
+    ;
+
+  if(argc - optind == 2)
+    models = read_models(argv[optind + 1], &n);
+  else
+    models = generate_models(generated, &n);
+  if(n == 0) {
+    fprintf(stderr, "dbbench: no model strings to look up\n");
+    exit(1);
+  }
+
+  /* lookups: each one timed on its own, the statistics of each round
+     and then their median over the rounds, which a busy machine
+     disturbs less than those of all the lookups together */
+  total = n * rounds;
+  times = (long long *) malloc(total * sizeof(long long));
+  stats = (double *) malloc(rounds * sizeof(double) * 4);
+  if(times == NULL || stats == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+
+  /* a first round isn't measured: the regexps build their automata as
+     they are used, and those of an image are only compiled then */
+  for(i = 0; i < n; i++)
+    is_a_supported_drive(models[i], &entry);
+
+  found = 0;
+  count_start();
+  for(j = 0; j < rounds; j++) {
+    for(i = 0; i < n; i++) {
+      t = clock_ns();
+      found += is_a_supported_drive(models[i], &entry);
+      times[j * n + i] = clock_ns() - t;
+    }
+  }
+  count_stop();
+  results[R_LOOKUP_ALLOCS].value = (double) alloc_count / total;
+
+  for(j = 0; j < rounds; j++) {
+    long long *round = times + j * n;
+
+    for(sum = 0, i = 0; i < n; i++)
+      sum += round[i];
+    qsort(round, n, sizeof(long long), compare_ll);
+    stats[j] = round[n / 2];
+    stats[rounds + j] = round[(long long) n * 90 / 100];
+    stats[2 * rounds + j] = round[(long long) n * 99 / 100];
+    stats[3 * rounds + j] = sum / n;
+    if(round[n - 1] > results[R_LOOKUP_MAX].value)
+      results[R_LOOKUP_MAX].value = round[n - 1];
+  }
+  results[R_LOOKUP_P50].value = median(stats, rounds);
+  results[R_LOOKUP_P90].value = median(stats + rounds, rounds);
+  results[R_LOOKUP_P99].value = median(stats + 2 * rounds, rounds);
+  results[R_LOOKUP_MEAN].value = median(stats + 3 * rounds, rounds);
+  free(stats);
+  free(times);
+
+  printf("database: %s, %d entries\n", argv[optind], nentries);
+  printf("load:     %.3f ms (median of %d)", results[R_LOAD_MS].value, load_runs);
+  if(HAVE_ALLOC_COUNT)
+    printf(", %.0f allocations, %.0f bytes", results[R_LOAD_ALLOCS].value, results[R_LOAD_BYTES].value);
+  printf("\n");
+  printf("lookups:  %d model strings x %d rounds, %d found\n", n, rounds, found / rounds);
+  printf("latency:  p50 %.0f ns, p90 %.0f ns, p99 %.0f ns, max %.0f ns, mean %.1f ns\n",
+         results[R_LOOKUP_P50].value, results[R_LOOKUP_P90].value,
+         results[R_LOOKUP_P99].value, results[R_LOOKUP_MAX].value,
+         results[R_LOOKUP_MEAN].value);
+  if(HAVE_ALLOC_COUNT)
+    printf("          %.2f allocations per lookup\n", results[R_LOOKUP_ALLOCS].value);
+
+  for(i = 0; i < n; i++)
+    free(models[i]);
+  free(models);
+  free_database();
+
+  if(save)
+    save_baseline(save);
+
+  if(baseline && compare_baseline(baseline, tolerance) > 0)
+    exit(1);
+
+  return 0;
+}
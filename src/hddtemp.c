@@ -21,6 +21,8 @@
  *
  */
 
+#define _GNU_SOURCE
+
 // Include file generated by ./configure
 #ifdef HAVE_CONFIG_H
 #include <config.h>
@@ -40,6 +42,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
+#include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -54,33 +58,88 @@
 #include <linux/hdreg.h>
 #include <ctype.h>
 #include <assert.h>
-#include <glob.h>
+#include <pthread.h>
 
 // Application specific includes
 #include "ata.h"
 #include "utf8.h"
 #include "sata.h"
 #include "scsi.h"
+#include "scsicmds.h"
 #include "nvme.h"
+#include "hwmon.h"
+#include "sysfs.h"
+#include "sgasync.h"
+#include "uring.h"
+#include "pool.h"
 #include "db.h"
 #include "hddtemp.h"
 #include "backtrace.h"
 #include "daemon.h"
+#include "buffer.h"
 
 
 #define PORT_NUMBER            7634
 #define SEPARATOR              '|'
+#define POLL_WORKERS           16
+#define LISTEN_BACKLOG         128
+#define UNIX_MODE              0666
+#define POLL_INTERVAL          60
+#define SYSFS_ROOT             "/sys"
+
+/* long options without a short equivalent */
+enum {
+  OPT_BACKLOG = 256,
+  OPT_METRICS,
+  OPT_FORMAT,
+  OPT_UNIX,
+  OPT_UNIX_MODE,
+  OPT_NO_TCP,
+  OPT_NO_HWMON,
+  OPT_SYSFS_ROOT,
+  OPT_INCLUDE,
+  OPT_EXCLUDE,
+  OPT_HOTPLUG,
+  OPT_UEVENT_SOCKET,
+  OPT_NVME_SHORT_LOG,
+  OPT_COMPILE_DB,
+  OPT_DB_DIR
+};
 
 char *             database_path = DEFAULT_DATABASE_PATH;
-long               portnum, syslog_interval;
+char *             database_dir = DEFAULT_DATABASE_DIR;
+long               portnum, syslog_interval, poll_workers, listen_backlog;
+long               adaptive_min, adaptive_max, metrics_port;
 char *             listen_addr;
+char *             unix_path;
+char *             sysfs_root = SYSFS_ROOT;
+char *             uevent_path;
+long               unix_mode = UNIX_MODE;
 char               separator = SEPARATOR;
+enum e_format      output_format = FORMAT_TEXT;
 
 struct bustype *   bus[BUS_TYPE_MAX];
-int                tcp_daemon, debug, quiet, numeric, wakeup, foreground, af_hint;
+int                hotplug, nvme_short_log, no_hwmon, no_tcp, tcp_daemon, debug, quiet, numeric, wakeup, foreground, af_hint;
 
 static enum { DEFAULT, CELSIUS, FAHRENHEIT } unit;
 
+/* --interval settings, either global or restricted to a bus type or a
+   drive */
+struct interval_rule {
+  struct interval_rule *   next;
+  const char *             target;
+  long                     seconds;
+};
+
+static struct interval_rule *interval_rules = NULL;
+
+/* --include and --exclude patterns, NULL-terminated */
+char **            include_patterns = NULL;
+char **            exclude_patterns = NULL;
+
+static int db_loaded = 0;
+static pthread_mutex_t db_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*******************************************************
  *******************************************************/
 
@@ -91,6 +150,7 @@ static void init_bus_types() {
 #ifdef HAVE_LINUX_NVME_IOCTL_H
   bus[BUS_NVME] = &nvme_bus;
 #endif
+  bus[BUS_HWMON] = &hwmon_bus;
 }
 
 /*******************************************************
@@ -124,11 +184,65 @@ char get_unit(struct disk *dsk) {
 }
 
 
+/* Short name of a reading outcome, for machine readable outputs. */
+const char *gettemp_name(enum e_gettemp ret) {
+  switch(ret) {
+  case GETTEMP_KNOWN:
+    return "known";
+  case GETTEMP_NOT_APPLICABLE:
+    return "not_applicable";
+  case GETTEMP_UNKNOWN:
+    return "unknown";
+  case GETTEMP_NOSENSOR:
+    return "nosensor";
+  case GETTEMP_DRIVE_SLEEP:
+    return "sleeping";
+  case GETTEMP_ERROR:
+  default:
+    return "error";
+  }
+}
+
+/* One JSON object describing the last reading of a disk. */
+void disk_json(struct buffer *out, struct disk *dsk) {
+  buffer_append(out, "{\"drive\":", 9);
+  buffer_json_string(out, dsk->drive);
+  buffer_append(out, ",\"model\":", 9);
+  buffer_json_string(out, dsk->model);
+  buffer_append(out, ",\"bus\":", 7);
+  buffer_json_string(out, (dsk->type > BUS_UNKNOWN && bus[dsk->type]) ? bus[dsk->type]->name : NULL);
+  buffer_append(out, ",\"status\":", 10);
+  buffer_json_string(out, gettemp_name(dsk->ret));
+
+  if(dsk->ret == GETTEMP_KNOWN)
+    buffer_printf(out, ",\"value\":%d,\"unit\":\"%c\"", value_to_unit(dsk), get_unit(dsk));
+  else
+    buffer_printf(out, ",\"value\":null,\"unit\":null");
+
+  buffer_append(out, ",\"errormsg\":", 12);
+  buffer_json_string(out, (dsk->ret == GETTEMP_ERROR || dsk->ret == GETTEMP_NOT_APPLICABLE) ? dsk->errormsg : NULL);
+  buffer_printf(out, ",\"last_time\":%ld}", (long) dsk->last_time);
+}
+
 
 static enum e_bustype probe_bus_type(struct disk *dsk) {
+  enum e_bustype type;
+
+  /* sysfs knows the bus, trying commands is only a fallback as a failed
+     one can cost a timeout on some USB bridges */
+  type = sysfs_bus_type(dsk->fd);
+
+  /* the kernel's own reading costs no command from hddtemp, but it has
+     no S.M.A.R.T. fields to show in debug mode, and drivetemp reads an
+     ATA drive without checking first that it is spun up */
+  if(!no_hwmon && !debug && (wakeup || (type != BUS_SATA && type != BUS_ATA)) &&
+     bus[BUS_HWMON]->probe(dsk->fd))
+    return BUS_HWMON;
+  else if(type != BUS_UNKNOWN)
+    return type;
   /* SATA disks answer to both ATA and SCSI commands so
      they have to be probed first in order to be detected */
-  if(bus[BUS_SATA]->probe(dsk->fd))
+  else if(bus[BUS_SATA]->probe(dsk->fd))
     return BUS_SATA;
   else if(bus[BUS_ATA]->probe(dsk->fd))
     return BUS_ATA;
@@ -142,6 +256,288 @@ static enum e_bustype probe_bus_type(struct disk *dsk) {
     return BUS_UNKNOWN;
 }
 
+/* Name of the drive itself, the same whichever path it is opened
+   through.  sysfs usually knows it, else SCSI and SATA drives are
+   asked for their VPD pages. */
+static char *disk_identity(struct disk *dsk) {
+  char          dir[PATH_MAX];
+  char          id[256];
+  unsigned char vpd[256];
+  char *        p;
+
+  if(sysfs_block_dir(dsk->fd, dir, sizeof(dir)) == 0 && (p = sysfs_identity(dir)) != NULL)
+    return p;
+
+  if(dsk->type != BUS_SATA && dsk->type != BUS_SCSI)
+    return NULL;
+
+  if(scsi_inquiry_vpd(dsk->fd, 0x83, vpd, sizeof(vpd)) == 0 &&
+     scsi_vpd_id(vpd, sizeof(vpd), id, sizeof(id)) == 0)
+    return strdup(id);
+
+  if(scsi_inquiry_vpd(dsk->fd, 0x80, vpd, sizeof(vpd)) == 0 &&
+     scsi_vpd_id(vpd, sizeof(vpd), id, sizeof(id)) == 0 &&
+     asprintf(&p, "serial.%s.%s", dsk->model, id) != -1)
+    return p;
+
+  return NULL;
+}
+
+/* Move a drive seen through several paths on to the next one, the
+   current path going last.  Returns 0 if the drive has no other path. */
+int disk_failover(struct disk *dsk) {
+  const char *drive;
+  int         n;
+
+  if(dsk->aliases == NULL || dsk->aliases[0] == NULL)
+    return 0;
+
+  if(dsk->fd != -1) {
+    close(dsk->fd);
+    dsk->fd = -1;
+  }
+
+  drive = dsk->drive;
+  dsk->drive = dsk->aliases[0];
+  for(n = 0; dsk->aliases[n + 1]; n++)
+    dsk->aliases[n] = dsk->aliases[n + 1];
+  dsk->aliases[n] = (char *) drive;
+
+  return 1;
+}
+
+/* Find the drive in the database, again when it was reloaded. */
+void disk_lookup(struct disk *dsk) {
+  if(dsk->db_entry == NULL || dsk->type == BUS_SCSI || dsk->type == BUS_HWMON)
+    return;
+
+  if(!is_a_supported_drive(dsk->model, dsk->db_entry)) {
+    dsk->db_entry->regexp       = "";
+    dsk->db_entry->description  = "";
+    dsk->db_entry->attribute_id = DEFAULT_ATTRIBUTE_ID;
+    dsk->db_entry->attribute_id2 = DEFAULT_ATTRIBUTE_ID2;
+    dsk->db_entry->unit         = 'C';
+    dsk->db_entry->next         = NULL;
+  }
+}
+
+/* Open a drive and identify it: bus type (unless it was forced), model
+   and database entry.  On failure, the drive is left closed with an
+   error message and a type of ERROR, or BUS_UNKNOWN if it could be
+   opened but not identified. */
+int disk_open(struct disk *dsk) {
+  errno = 0;
+  dsk->errormsg[0] = '\0';
+  dsk->type = dsk->forced;
+  dsk->caps = 0;
+  dsk->powermode_failures = dsk->powermode_skips = 0;
+  sg_release(dsk);
+  uring_release(dsk);
+  if( (dsk->fd = open(dsk->drive, O_RDONLY | O_NONBLOCK)) < 0) {
+    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "open: %s\n", strerror(errno));
+    dsk->type = ERROR;
+    return -1;
+  }
+
+  if( ! dsk->type ) {
+    dsk->type = probe_bus_type(dsk);
+  }
+
+  if(dsk->type == BUS_UNKNOWN) {
+    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("can't determine bus type"));
+    close(dsk->fd);
+    dsk->fd = -1;
+    return -1;
+  }
+
+  free((char *) dsk->model);
+  dsk->model = bus[dsk->type]->model(dsk->fd);
+  dsk->value = -1;
+
+  free(dsk->identity);
+  dsk->identity = disk_identity(dsk);
+
+  /* an NVMe SMART log is per controller, not per namespace */
+  free((char *) dsk->controller);
+  dsk->controller = NULL;
+  if(dsk->type == BUS_NVME)
+    dsk->controller = sysfs_device(dsk->fd);
+
+  if(dsk->type != BUS_SCSI && dsk->type != BUS_HWMON) {
+    /* drives are identified in parallel */
+    pthread_mutex_lock(&db_lock);
+    if(!db_loaded) {
+      load_database(database_path, database_dir);
+      db_loaded = 1;
+    }
+    pthread_mutex_unlock(&db_lock);
+
+    if(dsk->db_entry == NULL)
+      dsk->db_entry = (struct harddrive_entry *)malloc(sizeof(struct harddrive_entry));
+    disk_lookup(dsk);
+  }
+
+  return 0;
+}
+
+static void add_pattern(char ***patterns, char *pattern) {
+  int n;
+
+  for(n = 0; *patterns && (*patterns)[n]; n++)
+    ;
+
+  *patterns = realloc(*patterns, (n + 2) * sizeof(char *));
+  if(*patterns == NULL) {
+    perror("realloc");
+    exit(-1);
+  }
+  (*patterns)[n] = pattern;
+  (*patterns)[n + 1] = NULL;
+}
+
+static void disk_open_item(void *arg) {
+  disk_open((struct disk *) arg);
+}
+
+/* Keep one entry per physical drive: paths leading to a drive already
+   in the list (multipath, aliases) become its failover paths, so the
+   drive is only read through one of them. */
+static void collapse_aliases(struct disk *ldisks) {
+  struct disk ** pdsk;
+  struct disk *  dsk;
+  struct disk *  alias;
+
+  for(dsk = ldisks; dsk; dsk = dsk->next) {
+    if(dsk->identity == NULL)
+      continue;
+
+    for(pdsk = &dsk->next; (alias = *pdsk) != NULL; ) {
+      if(alias->identity == NULL || strcmp(alias->identity, dsk->identity) != 0) {
+        pdsk = &alias->next;
+        continue;
+      }
+
+      add_pattern(&dsk->aliases, (char *) alias->drive);
+      *pdsk = alias->next;
+      if(alias->fd != -1)
+        close(alias->fd);
+      free((char *) alias->model);
+      free((char *) alias->controller);
+      free(alias->identity);
+      free(alias->db_entry);
+      free(alias);
+    }
+  }
+}
+
+/* Opening and identifying a drive can take a command timeout or a spin
+   up, so all the drives are opened in parallel.  The list keeps its
+   order; drives whose bus can't be determined are dropped from it. */
+static void open_disks(struct disk **ldisks, int *ret) {
+  struct pool *  pool;
+  struct disk ** pdsk;
+  struct disk *  dsk;
+  void **        items;
+  int            n;
+
+  for(n = 0, dsk = *ldisks; dsk; dsk = dsk->next)
+    n++;
+
+  items = malloc((n ? n : 1) * sizeof(void *));
+  if(items == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+  for(n = 0, dsk = *ldisks; dsk; dsk = dsk->next)
+    items[n++] = dsk;
+
+  pool = pool_create(n < poll_workers ? n : poll_workers);
+  pool_run(pool, disk_open_item, items, n);
+  pool_destroy(pool);
+  free(items);
+
+  for(pdsk = ldisks; (dsk = *pdsk) != NULL; ) {
+    if(dsk->fd == -1) {
+      *ret = 1;
+      if(dsk->type == BUS_UNKNOWN) {
+        fprintf(stderr, _("ERROR: %s: can't determine bus type (or this bus type is unknown)\n"), dsk->drive);
+
+        *pdsk = dsk->next;
+        free(dsk);
+        continue;
+      }
+    }
+    pdsk = &dsk->next;
+  }
+}
+
+static void add_interval_rule(char *arg) {
+  struct interval_rule *rule;
+  char *p, *end = NULL;
+
+  rule = (struct interval_rule *) malloc(sizeof(struct interval_rule));
+  assert(rule);
+
+  p = strrchr(arg, ':');
+  if(p == NULL) {
+    rule->target = NULL;
+    p = arg;
+  }
+  else {
+    *p++ = '\0';
+    rule->target = arg;
+  }
+
+  errno = 0;
+  rule->seconds = strtol(p, &end, 10);
+  if(errno == ERANGE || end == p || *end != '\0' || rule->seconds < 1) {
+    fprintf(stderr, _("ERROR: invalid interval.\n"));
+    exit(1);
+  }
+
+  /* newest first, so that a later rule wins over an earlier one */
+  rule->next = interval_rules;
+  interval_rules = rule;
+}
+
+/* Reading interval of a drive, from the most specific --interval rule.
+   Called again when the daemon reopens a drive, as its bus may only be
+   known then. */
+void set_interval(struct disk *dsk) {
+  struct interval_rule *  rule;
+  struct interval_rule *  by_bus = NULL, *by_drive = NULL, *all = NULL;
+
+  for(rule = interval_rules; rule; rule = rule->next) {
+    if(rule->target == NULL) {
+      if(!all)
+        all = rule;
+    }
+    else if(!by_drive && strcmp(rule->target, dsk->drive) == 0)
+      by_drive = rule;
+    else if(!by_bus && dsk->type > BUS_UNKNOWN && bus[dsk->type] &&
+            strcasecmp(rule->target, bus[dsk->type]->name) == 0)
+      by_bus = rule;
+  }
+
+  if(by_drive)
+    dsk->interval = by_drive->seconds;
+  else if(by_bus)
+    dsk->interval = by_bus->seconds;
+  else if(all)
+    dsk->interval = all->seconds;
+  /* with no TCP client to serve, there is no point reading the drives
+     more often than they are logged */
+  else
+    dsk->interval = (!tcp_daemon && syslog_interval > 0) ? syslog_interval : POLL_INTERVAL;
+}
+
+static void set_intervals(struct disk *ldisks) {
+  struct disk *dsk;
+
+  for(dsk = ldisks; dsk; dsk = dsk->next)
+    set_interval(dsk);
+}
+
 /*
 static int get_smart_threshold_values(int fd, unsigned char* buff) {
   unsigned char cmd[516] = { WIN_SMART, 0, SMART_READ_THRESHOLDS, 1 };
@@ -243,9 +639,40 @@ static void display_temperature(struct disk *dsk) {
 }
 
 
+static void display_json(struct disk *ldisks) {
+  struct disk   *dsk;
+  struct buffer out;
+
+  buffer_init(&out);
+  buffer_append(&out, "[", 1);
+
+  for(dsk = ldisks; dsk; dsk = dsk->next) {
+    dsk->value = -1;
+    if(dsk->type == ERROR || bus[dsk->type]->get_temperature == NULL)
+      dsk->ret = GETTEMP_ERROR;
+    else
+      dsk->ret = bus[dsk->type]->get_temperature(dsk);
+    time(&dsk->last_time);
+
+    buffer_append(&out, "\n", 1);
+    disk_json(&out, dsk);
+    if(dsk->next)
+      buffer_append(&out, ",", 1);
+  }
+
+  buffer_append(&out, "\n]\n", 3);
+  fwrite(out.data, 1, out.len, stdout);
+  buffer_free(&out);
+}
+
 void do_direct_mode(struct disk *ldisks) {
   struct disk *dsk;
 
+  if(output_format == FORMAT_JSON) {
+    display_json(ldisks);
+    return;
+  }
+
   for(dsk = ldisks; dsk; dsk = dsk->next) {
     display_temperature(dsk);
   }
@@ -260,11 +687,12 @@ void do_direct_mode(struct disk *ldisks) {
 
 
 int main(int argc, char* argv[]) {
-  int           i, c, lindex = 0, db_loaded = 0;
+  int           i, c, lindex = 0;
   int           ret = 0;
-  int           show_db;
+  int           show_db, compile_db;
+  char *        compile_db_path = NULL;
   struct        disk * ldisks;
-  glob_t        diskglob;
+  char **       found;
 
   backtrace_sigsegv();
   backtrace_sigill();
@@ -274,9 +702,12 @@ int main(int argc, char* argv[]) {
   bindtextdomain (PACKAGE, LOCALEDIR);
   textdomain (PACKAGE);
 
-  show_db = debug = numeric = quiet = wakeup = af_hint = syslog_interval = foreground = 0;
+  show_db = compile_db = debug = numeric = quiet = wakeup = af_hint = syslog_interval = foreground = 0;
   unit = DEFAULT;
   portnum = PORT_NUMBER;
+  poll_workers = POLL_WORKERS;
+  listen_backlog = LISTEN_BACKLOG;
+  adaptive_min = adaptive_max = metrics_port = 0;
   listen_addr = NULL;
 
   /* Parse command line */
@@ -298,10 +729,28 @@ int main(int argc, char* argv[]) {
       {"unit",       1, NULL, 'u'},
       {"syslog",     1, NULL, 'S'},
       {"wake-up",    0, NULL, 'w'},
+      {"workers",    1, NULL, 'j'},
+      {"interval",   1, NULL, 'i'},
+      {"adaptive",   1, NULL, 'a'},
+      {"backlog",    1, NULL, OPT_BACKLOG},
+      {"metrics",    1, NULL, OPT_METRICS},
+      {"format",     1, NULL, OPT_FORMAT},
+      {"unix",       1, NULL, OPT_UNIX},
+      {"unix-mode",  1, NULL, OPT_UNIX_MODE},
+      {"no-tcp",     0, NULL, OPT_NO_TCP},
+      {"no-hwmon",   0, NULL, OPT_NO_HWMON},
+      {"sysfs-root", 1, NULL, OPT_SYSFS_ROOT},
+      {"include",    1, NULL, OPT_INCLUDE},
+      {"exclude",    1, NULL, OPT_EXCLUDE},
+      {"hotplug",    0, NULL, OPT_HOTPLUG},
+      {"uevent-socket", 1, NULL, OPT_UEVENT_SOCKET},
+      {"nvme-short-log", 0, NULL, OPT_NVME_SHORT_LOG},
+      {"compile-db", 2, NULL, OPT_COMPILE_DB},
+      {"db-dir",     1, NULL, OPT_DB_DIR},
       {0, 0, 0, 0}
     };
 
-    c = getopt_long (argc, argv, "bDdf:l:hp:qs:u:vnw46FS:", long_options, &lindex);
+    c = getopt_long (argc, argv, "a:bDdf:i:j:l:hp:qs:u:vnw46FS:", long_options, &lindex);
     if (c == -1)
       break;
 
@@ -368,8 +817,13 @@ int main(int argc, char* argv[]) {
 		 "   hddtemp displays the temperature of drives supplied in argument.\n"
 		 "   Drives must support S.M.A.R.T.\n"
 		 "\n"
-		 "  TYPE could be SATA, PATA or SCSI. If omitted hddtemp will try to guess.\n"
+		 "  TYPE could be SATA, PATA, SCSI, NVME or HWMON. If omitted hddtemp will try\n"
+		 "  to guess.\n"
 		 "\n"
+		 "  -a   --adaptive=min:max :\n"
+		 "                        in daemon mode, read each drive between every min and\n"
+		 "                        max seconds depending on how fast its temperature\n"
+		 "                        changes.\n"
 		 "  -b   --drivebase   :  display database file content that allow hddtemp to\n"
 		 "                        recognize supported drives.\n"
 		 "  -D   --debug       :  display various S.M.A.R.T. fields and their values.\n"
@@ -379,6 +833,10 @@ int main(int argc, char* argv[]) {
 		 "  -d   --daemon      :  run hddtemp in TCP/IP daemon mode (port %d by default.)\n"
 		 "  -f   --file=FILE   :  specify database file to use.\n"
 		 "  -F   --foreground  :  don't daemonize, stay in foreground.\n"
+		 "  -i   --interval=[TYPE:|DISK:]s :\n"
+		 "                        read drives every s seconds in daemon mode (%d by\n"
+		 "                        default), or only those of a bus TYPE or a DISK.\n"
+		 "  -j   --workers=#   :  number of drives opened or queried in parallel.\n"
 		 "  -l   --listen=addr :  listen on a specific interface (in TCP/IP daemon mode).\n"
                  "  -n   --numeric     :  print only the temperature.\n"
 		 "  -p   --port=#      :  port to listen to (in TCP/IP daemon mode).\n"
@@ -390,9 +848,39 @@ int main(int argc, char* argv[]) {
 		 "  -w   --wake-up     :  wake-up the drive if need.\n"
 		 "  -4                 :  listen on IPv4 sockets only.\n"
 		 "  -6                 :  listen on IPv6 sockets only.\n"
+		 "       --backlog=#   :  length of the pending connections queue (in TCP/IP\n"
+		 "                        daemon mode, %d by default).\n"
+		 "       --compile-db[=FILE] :\n"
+		 "                        compile the database and the --db-dir files into\n"
+		 "                        FILE (the database file name followed by .bin by\n"
+		 "                        default) and exit.\n"
+		 "       --db-dir=DIR  :  also read the *.db files of DIR after the database,\n"
+		 "                        the later ones taking precedence (%s by\n"
+		 "                        default, empty for none).\n"
+		 "       --exclude=PATTERN :\n"
+		 "                        don't autodetect the drives whose name matches.\n"
+		 "       --format=F    :  output format, text (default) or json.\n"
+		 "       --hotplug     :  add and remove drives as the kernel reports them (in\n"
+		 "                        daemon mode).\n"
+		 "       --include=PATTERN :\n"
+		 "                        only autodetect the drives whose name matches.\n"
+		 "       --metrics=#   :  also serve OpenMetrics at http://...:#/metrics (in\n"
+		 "                        TCP/IP daemon mode).\n"
+		 "       --no-hwmon    :  don't read temperatures from the kernel's hwmon\n"
+		 "                        interface, always send commands to the drives.\n"
+		 "       --no-tcp      :  don't listen on the TCP/IP port, only on --unix.\n"
+		 "       --nvme-short-log :\n"
+		 "                        only read the first bytes of the NVMe SMART log.\n"
+		 "       --sysfs-root=DIR :\n"
+		 "                        where sysfs is mounted (/sys by default).\n"
+		 "       --uevent-socket=PATH :\n"
+		 "                        take --hotplug events from a unix datagram socket\n"
+		 "                        instead of the kernel (for testing).\n"
+		 "       --unix=PATH   :  also listen on a unix domain socket (in daemon mode).\n"
+		 "       --unix-mode=M :  permissions of the --unix socket (%03o by default).\n"
 		 "\n"
 		 "Report bugs or new drives to <hddtemp@guzu.net>.\n"),
-	       PORT_NUMBER);
+	       PORT_NUMBER, POLL_INTERVAL, LISTEN_BACKLOG, DEFAULT_DATABASE_DIR, UNIX_MODE);
         exit(0);
         break;
       case 'v':
@@ -420,13 +908,147 @@ int main(int argc, char* argv[]) {
       case 'F':
         foreground = 1;
         break;
+      case OPT_UNIX:
+        /* the daemon chdir()s to / before binding */
+        if(optarg[0] != '/') {
+          fprintf(stderr, _("ERROR: unix socket path must be absolute.\n"));
+          exit(1);
+        }
+        unix_path = optarg;
+        break;
+      case OPT_UNIX_MODE:
+        {
+          char *end = NULL;
+
+          unix_mode = strtol(optarg, &end, 8);
+
+          if(errno == ERANGE || end == optarg || *end != '\0' || unix_mode < 0 || unix_mode > 0777) {
+            fprintf(stderr, _("ERROR: invalid unix socket mode.\n"));
+            exit(1);
+          }
+        }
+        break;
+      case OPT_NO_TCP:
+        no_tcp = 1;
+        break;
+      case OPT_NO_HWMON:
+        no_hwmon = 1;
+        break;
+      case OPT_SYSFS_ROOT:
+        sysfs_root = optarg;
+        break;
+      case OPT_INCLUDE:
+        add_pattern(&include_patterns, optarg);
+        break;
+      case OPT_EXCLUDE:
+        add_pattern(&exclude_patterns, optarg);
+        break;
+      case OPT_HOTPLUG:
+        hotplug = 1;
+        break;
+      case OPT_NVME_SHORT_LOG:
+        nvme_short_log = 1;
+        break;
+      case OPT_DB_DIR:
+        database_dir = optarg;
+        break;
+      case OPT_COMPILE_DB:
+        compile_db = 1;
+        compile_db_path = optarg;
+        break;
+      case OPT_UEVENT_SOCKET:
+        if(optarg[0] != '/') {
+          fprintf(stderr, _("ERROR: uevent socket path must be absolute.\n"));
+          exit(1);
+        }
+        uevent_path = optarg;
+        hotplug = 1;
+        break;
+      case OPT_FORMAT:
+        if(strcasecmp(optarg, "text") == 0)
+          output_format = FORMAT_TEXT;
+        else if(strcasecmp(optarg, "json") == 0)
+          output_format = FORMAT_JSON;
+        else {
+          fprintf(stderr, _("ERROR: invalid output format.\n"));
+          exit(1);
+        }
+        break;
+      case OPT_METRICS:
+        {
+          char *end = NULL;
+
+          metrics_port = strtol(optarg, &end, 10);
+
+          if(errno == ERANGE || end == optarg || *end != '\0' || metrics_port < 1) {
+            fprintf(stderr, _("ERROR: invalid port number.\n"));
+            exit(1);
+          }
+        }
+        break;
+      case OPT_BACKLOG:
+        {
+          char *end = NULL;
+
+          listen_backlog = strtol(optarg, &end, 10);
+
+          if(errno == ERANGE || end == optarg || *end != '\0' || listen_backlog < 1) {
+            fprintf(stderr, _("ERROR: invalid backlog.\n"));
+            exit(1);
+          }
+        }
+        break;
+      case 'i':
+        add_interval_rule(optarg);
+        break;
+      case 'a':
+        {
+          char *end = NULL;
+
+          errno = 0;
+          adaptive_min = strtol(optarg, &end, 10);
+          if(errno == 0 && end != optarg && *end == ':') {
+            char *max = end + 1;
+
+            adaptive_max = strtol(max, &end, 10);
+            if(end == max)
+              adaptive_max = 0;
+          }
+
+          if(errno == ERANGE || *end != '\0' || adaptive_min < 1 || adaptive_max < adaptive_min) {
+            fprintf(stderr, _("ERROR: invalid adaptive interval bounds.\n"));
+            exit(1);
+          }
+        }
+        break;
+      case 'j':
+        {
+          char *end = NULL;
+
+          poll_workers = strtol(optarg, &end, 10);
+
+          if(errno == ERANGE || end == optarg || *end != '\0' || poll_workers < 1) {
+            fprintf(stderr, _("ERROR: invalid number of workers.\n"));
+            exit(1);
+          }
+        }
+        break;
       default:
         exit(1);
       }
   }
 
+  if(compile_db) {
+    if(compile_database(database_path, database_dir, compile_db_path) == -1) {
+      if(errno)
+        perror(compile_db_path ? compile_db_path : database_path);
+      exit(2);
+    }
+    exit(0);
+  }
+
   if(show_db) {
-     load_database(database_path);
+     load_database(database_path, database_dir);
      display_supported_drives();
      exit(0);
   }
@@ -436,25 +1058,37 @@ int main(int argc, char* argv[]) {
     quiet = 1;
   }
 
+  if(debug && output_format == FORMAT_JSON) {
+    fprintf(stderr, _("ERROR: can't use --debug and --format=json options together.\n"));
+    exit(1);
+  }
+
+  if(hotplug && !tcp_daemon && syslog_interval == 0) {
+    fprintf(stderr, _("ERROR: --hotplug needs --daemon or --syslog.\n"));
+    exit(1);
+  }
+
+  if(tcp_daemon && no_tcp && unix_path == NULL && metrics_port == 0) {
+    fprintf(stderr, _("ERROR: --no-tcp needs a --unix socket to listen on.\n"));
+    exit(1);
+  }
+
   if(debug && (tcp_daemon || syslog_interval != 0)) {
     fprintf(stderr, _("ERROR: can't use --debug and --daemon or --syslog options together.\n"));
     exit(1);
   }
 
-  memset(&diskglob, 0, sizeof(glob_t));
+  found = NULL;
   if(argc - optind <= 0) {
-    int res = glob("/dev/[hs]d[a-z]", 0, NULL, &diskglob);
-    if (glob("/dev/nvme[0-9]n[1-9]", (res ? 0 : GLOB_APPEND), NULL, &diskglob) == 0 || res == 0 ) {
-      argc = diskglob.gl_pathc;
-      argv = diskglob.gl_pathv;
-      optind = 0;
-    } else {
-      argc = 0;
-    }
+    found = sysfs_list_disks(include_patterns, exclude_patterns);
+    for(argc = 0; found && found[argc]; argc++)
+      ;
+    argv = found;
+    optind = 0;
   }
 
-  if(argc - optind <= 0) {
-    globfree(&diskglob);
+  /* with --hotplug, the daemon can wait for drives to show up */
+  if(argc - optind <= 0 && !hotplug) {
     fprintf(stderr, _("Too few arguments: you must specify one drive, at least.\n"));
     exit(1);
   }
@@ -473,7 +1107,7 @@ int main(int argc, char* argv[]) {
 
     p = strchr(argv[i], ':');
     if(p == NULL)
-      dsk->drive = argv[i];
+      dsk->drive = strdup(argv[i]);
     else {
       char *q;
       int j;
@@ -493,67 +1127,37 @@ int main(int argc, char* argv[]) {
           }
       }
 
-      dsk->drive = p + 1;
+      dsk->drive = strdup(p + 1);
     }
 
+    dsk->forced = dsk->type;
     dsk->next = ldisks;
     ldisks = dsk;
-
-    errno = 0;
-    dsk->errormsg[0] = '\0';
-    if( (dsk->fd = open(dsk->drive, O_RDONLY | O_NONBLOCK)) < 0) {
-      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "open: %s\n", strerror(errno));
-      dsk->type = ERROR;
-      ret = 1;
-      continue;
-    }
-
-    if( ! dsk->type ) {
-      dsk->type = probe_bus_type(dsk);
-    }
-
-    if(dsk->type == BUS_UNKNOWN) {
-      fprintf(stderr, _("ERROR: %s: can't determine bus type (or this bus type is unknown)\n"), dsk->drive);
-
-      ldisks = dsk->next;
-      free(dsk);
-      ret = 1;
-      continue;
-    }
-
-    dsk->model = bus[dsk->type]->model(dsk->fd);
-    dsk->value = -1;
-    if(dsk->type != BUS_SCSI) {
-      struct harddrive_entry   *dbe;
-
-      if(!db_loaded) {
-        load_database(database_path);
-        db_loaded = 1;
-      }
-
-      dsk->db_entry = (struct harddrive_entry *)malloc(sizeof(struct harddrive_entry));
-      dbe = is_a_supported_drive(dsk->model);
-      if(dbe)
-        memcpy(dsk->db_entry, dbe, sizeof(struct harddrive_entry));
-      else {
-        dsk->db_entry->regexp       = "";
-        dsk->db_entry->description  = "";
-        dsk->db_entry->attribute_id = DEFAULT_ATTRIBUTE_ID;
-        dsk->db_entry->attribute_id2 = DEFAULT_ATTRIBUTE_ID2;
-        dsk->db_entry->unit         = 'C';
-        dsk->db_entry->next         = NULL;
-      }
-    }
   }
 
-  free_database();
+  open_disks(&ldisks, &ret);
+  collapse_aliases(ldisks);
+
   if(tcp_daemon || syslog_interval != 0) {
+    /* drives that fail are identified again when the daemon reopens
+       them, so the database stays loaded; without one, they fall back
+       on the default attributes */
+    if(!db_loaded) {
+      if(access(database_path, R_OK) == 0)
+        load_database(database_path, database_dir);
+      else
+        fprintf(stderr, _("hddtemp: can't open %1$s: %2$s, using the default attributes\n"),
+                database_path, strerror(errno));
+      db_loaded = 1;
+    }
+    set_intervals(ldisks);
     do_daemon_mode(ldisks);
   }
   else {
+    free_database();
     do_direct_mode(ldisks);
   }
-  globfree(&diskglob);
+  sysfs_free_list(found);
 
   return ret;
 }
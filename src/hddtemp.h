@@ -21,6 +21,7 @@
 
 #include <time.h>
 #include "db.h"
+#include "wheel.h"
 
 //#ifdef ARCH_I386
 //typedef unsigned short u16;
@@ -29,13 +30,25 @@
 typedef __u16 u16;
 
 #define MAX_ERRORMSG_SIZE      128
+
+/* what a drive was found to support, cached in struct disk until an
+   error or a reopen so that a reading only sends the command it needs */
+#define CAP_SMART              0x01    /* S.M.A.R.T. checked and enabled */
+#define CAP_NO_POWERMODE       0x02    /* CHECK POWER MODE unsupported, for now */
+#define CAP_TEMP_PAGE          0x04    /* SCSI temperature log page present */
+#define CAP_HWMON              0x08    /* fd is the hwmon temperature input */
+#define CAP_NO_SG              0x10    /* no sg node for asynchronous commands */
+#define CAP_NO_URING           0x20    /* no io_uring passthrough for the drive */
+#define CAP_NVME_FULL_LOG      0x40    /* partial SMART log reads refused */
+#define POWERMODE_MAX_FAILURES 3       /* CHECK POWER MODE failures before giving it up */
+#define POWERMODE_RETRY        60      /* readings before asking again */
 #define DEFAULT_ATTRIBUTE_ID   194
 #define DEFAULT_ATTRIBUTE_ID2  190
 
 #define F_to_C(val) (int)(((double)(val)-32.0)/1.8)
 #define C_to_F(val) (int)(((double)(val)*(double)1.8) + (double)32.0)
 
-enum e_bustype { ERROR = 0, BUS_UNKNOWN, BUS_SATA, BUS_ATA, BUS_SCSI, BUS_NVME, BUS_TYPE_MAX };
+enum e_bustype { ERROR = 0, BUS_UNKNOWN, BUS_SATA, BUS_ATA, BUS_SCSI, BUS_NVME, BUS_HWMON, BUS_TYPE_MAX };
 enum e_gettemp {
   GETTEMP_ERROR,            /* Error */
   GETTEMP_NOT_APPLICABLE,   /* */
@@ -44,8 +57,10 @@ enum e_gettemp {
   GETTEMP_NOSENSOR,         /* Drive appear in database but is known to have no sensor */
   GETTEMP_DRIVE_SLEEP       /* Drive is sleeping */
 };
+enum e_format { FORMAT_TEXT, FORMAT_JSON };
 enum e_powermode {
   PWM_UNKNOWN,
+  PWM_UNSUPPORTED,          /* the drive aborted the command */
   PWM_ACTIVE,
   PWM_SLEEPING,
   PWM_STANDBY
@@ -58,13 +73,32 @@ struct disk {
   int                      fd;
   const char *             drive;
   const char *             model;
+  const char *             controller;    /* shared by the namespaces of an NVMe controller */
+  char *                   identity;      /* WWN or serial number, whatever the path */
+  char **                  aliases;       /* other paths to the same drive, for failover */
   enum e_bustype           type;
+  enum e_bustype           forced;        /* type given on the command line */
+  unsigned int             caps;          /* CAP_* flags */
+  struct sg_cmd *          sg;            /* sg node, once used asynchronously */
+  struct uring_cmd *       uring;         /* io_uring passthrough node, likewise */
   int                      value;
   struct harddrive_entry * db_entry;
 
   char                     errormsg[MAX_ERRORMSG_SIZE];
   enum e_gettemp           ret;
   time_t                   last_time;
+
+  long                     interval;      /* seconds between two readings */
+  struct timer             timer;         /* next reading, in daemon mode */
+
+  int                      prev_value;    /* --adaptive: previous reading, */
+  long                     prev_time;     /* when it was taken (ms), */
+  double                   rate;          /* and smoothed degrees per second */
+
+  int                      failures;      /* reopen attempts since the drive failed */
+  int                      powermode_failures;  /* CHECK POWER MODE failed in a row, */
+  int                      powermode_skips;     /* or readings since it was given up */
+  struct disk *            leader;        /* namespace whose reading is shared, in a sweep */
 };
 
 struct bustype {
@@ -72,17 +106,40 @@ struct bustype {
   int (*probe)(int);
   const char *(*model)(int);
   enum e_gettemp (*get_temperature)(struct disk *);
+  /* optional asynchronous reading: submit returns -1 when the drive has
+     to be read with get_temperature, complete returns 1 when it sent a
+     follow-up command and 0 once dsk->ret is set */
+  int (*submit)(struct disk *);
+  int (*complete)(struct disk *);
 };
 
 
 extern struct bustype *   bus[BUS_TYPE_MAX];
 extern char               errormsg[MAX_ERRORMSG_SIZE];
-extern int                tcp_daemon, debug, quiet, wakeup, af_hint, foreground;
+extern int                hotplug, nvme_short_log, no_hwmon, no_tcp, tcp_daemon, debug, quiet, wakeup, af_hint, foreground;
 extern char               separator;
-extern long               portnum, syslog_interval;
+extern enum e_format      output_format;
+extern long               portnum, syslog_interval, poll_workers, listen_backlog;
+extern long               adaptive_min, adaptive_max, metrics_port;
+extern char *             database_path;
+extern char *             database_dir;
 extern char *             listen_addr;
+extern char *             unix_path;
+extern char *             sysfs_root;
+extern char *             uevent_path;
+extern char **            include_patterns;
+extern char **            exclude_patterns;
+extern long               unix_mode;
 
 int value_to_unit(struct disk *dsk);
 char get_unit(struct disk *dsk);
+const char *gettemp_name(enum e_gettemp ret);
+int disk_open(struct disk *dsk);
+void disk_lookup(struct disk *dsk);
+int disk_failover(struct disk *dsk);
+void set_interval(struct disk *dsk);
+
+struct buffer;
+void disk_json(struct buffer *out, struct disk *dsk);
 
 #endif
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Temperatures read from the kernel's hardware monitoring interface.
+ * The drivetemp driver (ATA/SATA) and the nvme driver publish them in
+ * millidegrees Celsius in a temp1_input file, which costs a pread() and
+ * no command from hddtemp, hence no passthrough ioctl and no privilege.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Gettext includes
+#if ENABLE_NLS
+#include <libintl.h>
+#define _(String) gettext (String)
+#else
+#define _(String) (String)
+#endif
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <unistd.h>
+
+// Application specific includes
+#include "hddtemp.h"
+#include "sysfs.h"
+#include "hwmon.h"
+
+#define ATA_INFO_IDENTIFY      60      /* IDENTIFY data in the ATA Information VPD page */
+
+/* drivetemp registers its hwmon device below the SCSI device, the nvme
+   driver directly in the controller's directory */
+static const char *hwmon_patterns[] = {
+  "%s/device/hwmon/hwmon*/temp1_input",
+  "%s/device/hwmon*/temp1_input"
+};
+
+static int hwmon_find(int device, char *path, size_t size) {
+  char     dir[PATH_MAX];
+  char     pattern[PATH_MAX + 32];
+  glob_t   g;
+  unsigned i;
+
+  if(sysfs_block_dir(device, dir, sizeof(dir)) == -1)
+    return -1;
+
+  for(i = 0; i < sizeof(hwmon_patterns) / sizeof(hwmon_patterns[0]); i++) {
+    snprintf(pattern, sizeof(pattern), hwmon_patterns[i], dir);
+    if(glob(pattern, 0, NULL, &g) == 0) {
+      snprintf(path, size, "%s", g.gl_pathv[0]);
+      globfree(&g);
+      return 0;
+    }
+    globfree(&g);
+  }
+
+  return -1;
+}
+
+static int hwmon_probe(int device) {
+  char path[PATH_MAX];
+
+  return hwmon_find(device, path, sizeof(path)) == 0;
+}
+
+static const char *hwmon_model(int device) {
+  char          dir[PATH_MAX];
+  char          path[PATH_MAX + 32];
+  unsigned char vpd[ATA_INFO_IDENTIFY + 512];
+  char          model[256];
+  int           fd, i, n;
+
+  if(sysfs_block_dir(device, dir, sizeof(dir)) == -1)
+    return strdup(_("unknown"));
+
+  /* the SCSI model of an ATA disk is cut to 16 characters, the IDENTIFY
+     data the kernel keeps in the ATA Information VPD page is not */
+  snprintf(path, sizeof(path), "%s/device/vpd_pg89", dir);
+  if((fd = open(path, O_RDONLY)) != -1) {
+    n = read(fd, vpd, sizeof(vpd));
+    close(fd);
+    if(n == (int) sizeof(vpd)) {
+      /* words 27 to 46, byte swapped */
+      for(i = 0; i < 40; i += 2) {
+        model[i] = vpd[ATA_INFO_IDENTIFY + 54 + i + 1];
+        model[i + 1] = vpd[ATA_INFO_IDENTIFY + 54 + i];
+      }
+      for(n = 40; n > 0 && model[n - 1] == ' '; n--)
+        ;
+      model[n] = '\0';
+      if(n > 0)
+        return strdup(model);
+    }
+  }
+
+  snprintf(path, sizeof(path), "%s/device/model", dir);
+  if(sysfs_read(path, model, sizeof(model)) > 0)
+    return strdup(model);
+
+  return strdup(_("unknown"));
+}
+
+static enum e_gettemp hwmon_get_temperature(struct disk *dsk) {
+  char    buf[32];
+  char    path[PATH_MAX];
+  ssize_t n;
+  long    millideg;
+  int     fd;
+
+  /* hwmon always reports Celsius, whatever the database says */
+  if(dsk->db_entry == NULL) {
+    dsk->db_entry = (struct harddrive_entry*) malloc(sizeof(struct harddrive_entry));
+    if(dsk->db_entry == NULL) {
+      perror("malloc");
+      exit(-1);
+    }
+  }
+
+  dsk->db_entry->regexp       = "";
+  dsk->db_entry->description  = "";
+  dsk->db_entry->attribute_id = 0;
+  dsk->db_entry->attribute_id2 = 0;
+  dsk->db_entry->unit         = 'C';
+  dsk->db_entry->next         = NULL;
+
+  /* the block device is only needed to find the hwmon input, which then
+     takes its place for every following reading */
+  if(!(dsk->caps & CAP_HWMON)) {
+    if(hwmon_find(dsk->fd, path, sizeof(path)) == -1 || (fd = open(path, O_RDONLY)) == -1) {
+      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("no hwmon temperature input"));
+      close(dsk->fd);
+      dsk->fd = -1;
+      return GETTEMP_ERROR;
+    }
+
+    dup2(fd, dsk->fd);
+    close(fd);
+    dsk->caps |= CAP_HWMON;
+  }
+
+  n = pread(dsk->fd, buf, sizeof(buf) - 1, 0);
+  if(n <= 0) {
+    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", n < 0 ? strerror(errno) : _("empty hwmon input"));
+    dsk->caps = 0;
+    close(dsk->fd);
+    dsk->fd = -1;
+    return GETTEMP_ERROR;
+  }
+  buf[n] = '\0';
+
+  millideg = strtol(buf, NULL, 10);
+  dsk->value = (millideg + (millideg < 0 ? -500 : 500)) / 1000;
+
+  return GETTEMP_KNOWN;
+}
+
+/*******************************
+ *******************************/
+
+struct bustype hwmon_bus = {
+  "HWMON",
+  hwmon_probe,
+  hwmon_model,
+  hwmon_get_temperature,
+  NULL,
+  NULL
+};
@@ -23,14 +23,21 @@
 
 #ifdef HAVE_LINUX_NVME_IOCTL_H
 #include "hddtemp.h"
+#include "sysfs.h"
+#include "uring.h"
 #include <sys/ioctl.h>
 #include <linux/nvme_ioctl.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
+#include <limits.h>
 
 
+#define NVME_SHORT_LOG_SIZE  4   /* critical warning and composite temperature */
+
 struct nvme_smart_log {
   unsigned char  critical_warning;
   unsigned char  temperature[2];
@@ -152,18 +159,34 @@ static int nvme_probe(int fd)
   return (ioctl(fd, NVME_IOCTL_ID, NULL) > 0);
 }
 
-static bool nvme_read_smart_log(int fd, struct nvme_smart_log *smart_log)
+/* Get Log Page of the controller-wide SMART log.  With --nvme-short-log
+   only its first dword, which holds the composite temperature, is
+   transferred, unless the controller refused that before. */
+static unsigned int nvme_log_size(struct disk *disk)
+{
+  if (nvme_short_log && !(disk->caps & CAP_NVME_FULL_LOG))
+    return NVME_SHORT_LOG_SIZE;
+  return sizeof(struct nvme_smart_log);
+}
+
+/* log id and NUMDL; the log is always read from offset 0 (LPOL/LPOU
+   in cdw12/cdw13) */
+static unsigned int nvme_log_cdw10(unsigned int size)
+{
+  return 0x02 | (((size / 4) - 1) << 16);
+}
+
+static bool nvme_read_smart_log(int fd, struct nvme_smart_log *smart_log, unsigned int size)
 {
-  unsigned int size = sizeof(*smart_log);
   struct nvme_passthru_cmd pt = { 0 };
 
-  memset(smart_log, 0, size);
+  memset(smart_log, 0, sizeof(*smart_log));
   pt.opcode = 0x02;
   pt.nsid = 0xffffffff;
   pt.addr = (uint64_t)smart_log;
   pt.data_len = size;
-  pt.cdw10 = 0x02 | (((size / 4) - 1) << 16);
-  if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &pt) < 0)
+  pt.cdw10 = nvme_log_cdw10(size);
+  if (ioctl(fd, NVME_IOCTL_ADMIN_CMD, &pt) != 0)
     return false;
   return true;
 }
@@ -191,7 +214,7 @@ const char *nvme_model(int fd)
   const unsigned int name_len = sizeof(id.mn);
 
   if (nvme_read_id_ctrl(fd, &id) == false)
-    return "NVME Disk";
+    return strdup("NVME Disk");
   id.mn[name_len-1] = '\0';
   for (i = name_len - 2; i > 0; i--) {
     if (id.mn[i] == ' ')
@@ -207,8 +230,10 @@ const char *nvme_model(int fd)
       break;
   }
   p = strdup(p);
-  if (!p || strlen(p) == 0)
-      return "NVME Disk";
+  if (!p || strlen(p) == 0) {
+      free(p);
+      return strdup("NVME Disk");
+  }
   for (i = 0; p[i]; i++) {
     if (p[i] < 0x20 || p[i] > 0x7e)
       p[i] = '?';
@@ -219,16 +244,102 @@ const char *nvme_model(int fd)
 enum e_gettemp nvme_get_temperature(struct disk *disk)
 {
   struct nvme_smart_log smart_log;
-  if (nvme_read_smart_log(disk->fd, &smart_log) == false)
-    return GETTEMP_UNKNOWN;
+
+  if (nvme_read_smart_log(disk->fd, &smart_log, nvme_log_size(disk)) == false) {
+    if (nvme_log_size(disk) == sizeof(smart_log))
+      return GETTEMP_UNKNOWN;
+    disk->caps |= CAP_NVME_FULL_LOG;
+    if (nvme_read_smart_log(disk->fd, &smart_log, sizeof(smart_log)) == false)
+      return GETTEMP_UNKNOWN;
+  }
   disk->value = smart_log.temperature[0] + (smart_log.temperature[1] << 8) - 273;
   return GETTEMP_KNOWN;
 }
   
+#ifdef NVME_URING_CMD_ADMIN
+/*
+ * In daemon mode the SMART log of every namespace is requested through
+ * io_uring on its generic character device (/dev/ngXnY), all in one
+ * submission, and the ioctl above is kept for kernels that can't.
+ */
+static int nvme_generic_path(int fd, char *path, size_t size)
+{
+  char dir[PATH_MAX];
+  char real[PATH_MAX];
+  char *name;
+
+  if (sysfs_block_dir(fd, dir, sizeof(dir)) == -1 || realpath(dir, real) == NULL)
+    return -1;
+
+  name = strrchr(real, '/') + 1;
+  if (strncmp(name, "nvme", 4) != 0)
+    return -1;
+
+  if ((size_t) snprintf(path, size, "/dev/ng%s", name + 4) >= size)
+    return -1;
+  return 0;
+}
+
+static int nvme_submit(struct disk *disk)
+{
+  struct nvme_uring_cmd cmd = { 0 };
+  char path[PATH_MAX];
+
+  if (disk->uring == NULL) {
+    if (disk->caps & CAP_NO_URING)
+      return -1;
+    if (nvme_generic_path(disk->fd, path, sizeof(path)) == -1 ||
+        uring_attach(disk, path) == -1) {
+      disk->caps |= CAP_NO_URING;
+      return -1;
+    }
+  }
+
+  disk->value = -1;
+  cmd.opcode = 0x02;
+  cmd.nsid = 0xffffffff;
+  cmd.addr = (uint64_t)(uintptr_t)disk->uring->data;
+  cmd.data_len = nvme_log_size(disk);
+  cmd.cdw10 = nvme_log_cdw10(cmd.data_len);
+  return uring_submit(disk, NVME_URING_CMD_ADMIN, &cmd, sizeof(cmd));
+}
+
+static int nvme_complete(struct disk *disk)
+{
+  struct nvme_smart_log *smart_log = (struct nvme_smart_log *)disk->uring->data;
+  int res = disk->uring->res;
+
+  if (res == 0) {
+    disk->value = smart_log->temperature[0] + (smart_log->temperature[1] << 8) - 273;
+    disk->ret = GETTEMP_KNOWN;
+    return 0;
+  }
+
+  /* without passthrough support the drive goes back to the ioctl */
+  if (res == -EOPNOTSUPP || res == -EINVAL || res == -ENOTTY || res == -EACCES || res == -EPERM)
+    disk->caps |= CAP_NO_URING;
+  if (res < 0)
+    uring_release(disk);
+
+  if (res == -ETIMEDOUT)
+    disk->ret = GETTEMP_UNKNOWN;
+  else
+    disk->ret = nvme_get_temperature(disk);
+  return 0;
+}
+#endif
+
 struct bustype nvme_bus = {
   "NVME",
   nvme_probe,
   nvme_model,
-  nvme_get_temperature
+  nvme_get_temperature,
+#ifdef NVME_URING_CMD_ADMIN
+  nvme_submit,
+  nvme_complete
+#else
+  NULL,
+  NULL
+#endif
 };
 #endif
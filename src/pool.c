@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Small fixed-size worker pool.  pool_run() hands an array of items to
+ * the workers and returns once every item has been processed, so the
+ * caller sees the same synchronous behaviour as a plain loop.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+
+// Application specific includes
+#include "pool.h"
+
+struct pool {
+  pthread_mutex_t   lock;
+  pthread_cond_t    work;
+  pthread_cond_t    done;
+  pthread_t *       threads;
+  int               nworkers;
+  int               stop;
+
+  void              (*fn)(void *);
+  void **           items;
+  int               nitems;
+  int               next;
+  int               pending;
+};
+
+static void *pool_worker(void *arg) {
+  struct pool *pl = (struct pool *) arg;
+
+  pthread_mutex_lock(&pl->lock);
+  while(1) {
+    int i;
+
+    while(!pl->stop && pl->next >= pl->nitems)
+      pthread_cond_wait(&pl->work, &pl->lock);
+
+    if(pl->stop)
+      break;
+
+    i = pl->next++;
+    pthread_mutex_unlock(&pl->lock);
+
+    pl->fn(pl->items[i]);
+
+    pthread_mutex_lock(&pl->lock);
+    if(--pl->pending == 0)
+      pthread_cond_signal(&pl->done);
+  }
+  pthread_mutex_unlock(&pl->lock);
+
+  return NULL;
+}
+
+struct pool *pool_create(int nworkers) {
+  struct pool *  pl;
+  sigset_t       all, old;
+  int            i;
+
+  pl = (struct pool *) malloc(sizeof(struct pool));
+  if(pl == NULL)
+    return NULL;
+
+  memset(pl, 0, sizeof(struct pool));
+  pthread_mutex_init(&pl->lock, NULL);
+  pthread_cond_init(&pl->work, NULL);
+  pthread_cond_init(&pl->done, NULL);
+
+  /* with a single worker there is nothing to gain from a thread */
+  if(nworkers <= 1)
+    return pl;
+
+  pl->threads = (pthread_t *) malloc(sizeof(pthread_t) * nworkers);
+  if(pl->threads == NULL)
+    return pl;
+
+  /* signals must keep being delivered to the main thread */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  for(i = 0; i < nworkers; i++) {
+    if(pthread_create(&pl->threads[i], NULL, pool_worker, pl) != 0)
+      break;
+  }
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  pl->nworkers = i;
+
+  return pl;
+}
+
+void pool_run(struct pool *pl, void (*fn)(void *), void **items, int nitems) {
+  int i;
+
+  if(nitems <= 0)
+    return;
+
+  if(pl == NULL || pl->nworkers == 0 || nitems == 1) {
+    for(i = 0; i < nitems; i++)
+      fn(items[i]);
+    return;
+  }
+
+  pthread_mutex_lock(&pl->lock);
+  pl->fn = fn;
+  pl->items = items;
+  pl->nitems = nitems;
+  pl->next = 0;
+  pl->pending = nitems;
+  pthread_cond_broadcast(&pl->work);
+
+  while(pl->pending > 0)
+    pthread_cond_wait(&pl->done, &pl->lock);
+
+  pl->items = NULL;
+  pl->nitems = 0;
+  pl->next = 0;
+  pthread_mutex_unlock(&pl->lock);
+}
+
+void pool_destroy(struct pool *pl) {
+  int i;
+
+  if(pl == NULL)
+    return;
+
+  pthread_mutex_lock(&pl->lock);
+  pl->stop = 1;
+  pthread_cond_broadcast(&pl->work);
+  pthread_mutex_unlock(&pl->lock);
+
+  for(i = 0; i < pl->nworkers; i++)
+    pthread_join(pl->threads[i], NULL);
+
+  free(pl->threads);
+  pthread_cond_destroy(&pl->done);
+  pthread_cond_destroy(&pl->work);
+  pthread_mutex_destroy(&pl->lock);
+  free(pl);
+}
@@ -44,6 +44,7 @@
 #include "atacmds.h"
 #include "satacmds.h"
 #include "scsicmds.h"
+#include "sgasync.h"
 
 #define swapb(x) \
 ({ \
@@ -123,31 +124,54 @@ static unsigned char* sata_search_temperature(const unsigned char* smart_data, i
     return (unsigned char*)(smart_data + n);
 }
 
-static enum e_gettemp sata_get_temperature(struct disk *dsk) {   
-  unsigned char    values[512];
+/* pick the temperature out of the SMART READ VALUES data */
+static enum e_gettemp sata_read_values(struct disk *dsk, unsigned char *values) {
   unsigned char *  field;
   int              i;
   u16 *            p;
 
+  p = (u16*)values;
+  for(i = 0; i < 256; i++) {
+    swapb(*(p+i));
+  }
+
+  if (debug)
+      sata_print_fields(values);
+
+  /* temperature */
+  field = sata_search_temperature(values, dsk->db_entry->attribute_id);
+  if(!field && dsk->db_entry->attribute_id2 != 0)
+    field = sata_search_temperature(values, dsk->db_entry->attribute_id2);
+
+  if(field)
+    dsk->value = *(field+3);
+
+  if(dsk->db_entry && dsk->value != -1)
+    return GETTEMP_KNOWN;
+  else
+    return GETTEMP_UNKNOWN;
+}
+
+static enum e_gettemp sata_get_temperature(struct disk *dsk) {   
+  unsigned char    values[512];
+
   if(dsk->db_entry->attribute_id == 0) {
     close(dsk->fd);
     dsk->fd = -1;
     return GETTEMP_NOSENSOR;
   }
 
-  switch(ata_get_powermode(dsk->fd)) {
-  case PWM_STANDBY:
-  case PWM_SLEEPING:
-    if (!wakeup)
+  /* the drive is read anyway with --wake-up */
+  if(ata_check_powermode(dsk)) {
+    enum e_powermode state = ata_get_powermode(dsk->fd);
+
+    ata_powermode_result(dsk, state);
+    if(state == PWM_STANDBY || state == PWM_SLEEPING)
       return GETTEMP_DRIVE_SLEEP;
-  case PWM_UNKNOWN:
-  case PWM_ACTIVE: /* active or idle */
-  default:
-    break;
   }
 
-  /* get SMART values */
-  if(sata_enable_smart(dsk->fd) != 0) {
+  /* get SMART values, enabling them once */
+  if(!(dsk->caps & CAP_SMART) && sata_enable_smart(dsk->fd) != 0) {
     enum e_gettemp ret;
     if(errno == EIO) {
       snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("S.M.A.R.T. not available"));
@@ -162,36 +186,96 @@ static enum e_gettemp sata_get_temperature(struct disk *dsk) {
     dsk->fd = -1;
     return ret;
   }
+  dsk->caps |= CAP_SMART;
 
   if(sata_get_smart_values(dsk->fd, values)) {
     snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", strerror(errno));
+    dsk->caps = 0;
     close(dsk->fd);
     dsk->fd = -1;
     return GETTEMP_ERROR;
   }
 
-  p = (u16*)values;
-  for(i = 0; i < 256; i++) {
-    swapb(*(p+i));
-  }
+  return sata_read_values(dsk, values);
+}
 
-  if (debug)
-      sata_print_fields(values);
 
-  /* temperature */
-  field = sata_search_temperature(values, dsk->db_entry->attribute_id);
-  if(!field && dsk->db_entry->attribute_id2 != 0)
-    field = sata_search_temperature(values, dsk->db_entry->attribute_id2);
+/* With S.M.A.R.T. enabled, a reading is CHECK POWER MODE, unless the
+   drive is to be woken up anyway, then SMART READ VALUES.  The daemon
+   sends these through the sg node of the drive, chaining the second
+   from the completion of the first. */
+#define SATA_STEP_POWERMODE    0
+#define SATA_STEP_VALUES       1
 
-  if(field)
-    dsk->value = *(field+3);
+static int sata_submit_cmd(struct disk *dsk, unsigned char *cmd, int step) {
+  unsigned char cdb[16];
+  int           dxfer_direction;
 
-  if(dsk->db_entry && dsk->value != -1)
-    return GETTEMP_KNOWN;
+  dxfer_direction = sata_build_cdb(cmd, cdb);
+  if(sg_submit(dsk, cdb, sizeof(cdb), cmd[3] * 512, dxfer_direction) == -1)
+    return -1;
+
+  dsk->sg->step = step;
+  return 0;
+}
+
+static int sata_submit(struct disk *dsk) {
+  unsigned char powermode[4] = { WIN_CHECKPOWERMODE1, 0, 0, 0 };
+  unsigned char values[4] = { WIN_SMART, 0, SMART_READ_VALUES, 1 };
+
+  if(!(dsk->caps & CAP_SMART) || dsk->db_entry->attribute_id == 0 ||
+     sg_attach(dsk) == -1)
+    return -1;
+
+  dsk->value = -1;
+
+  if(ata_check_powermode(dsk))
+    return sata_submit_cmd(dsk, powermode, SATA_STEP_POWERMODE);
   else
-    return GETTEMP_UNKNOWN;
+    return sata_submit_cmd(dsk, values, SATA_STEP_VALUES);
+}
+
+static int sata_complete(struct disk *dsk) {
+  unsigned char   values[4] = { WIN_SMART, 0, SMART_READ_VALUES, 1 };
+  struct sg_cmd * cmd = dsk->sg;
+  unsigned char * desc = cmd->sense + 8;
+  int             err = cmd->error ? cmd->error : EIO;
+
+  /* the sense data carries the ATA registers, as CK_COND is set */
+  if(cmd->error == 0 && cmd->sense[0] == 0x72) {
+    if(cmd->step == SATA_STEP_VALUES) {
+      dsk->ret = sata_read_values(dsk, cmd->data);
+      return 0;
+    }
+
+    /* ATA status return descriptor, error register at 3, count at 5,
+       status at 13 */
+    if(desc[0] != 0x09)
+      ata_powermode_result(dsk, PWM_UNKNOWN);
+    else if((desc[13] & 0x01) && (desc[3] & 0x04))
+      ata_powermode_result(dsk, PWM_UNSUPPORTED);
+    else if(desc[13] & 0x01)
+      ata_powermode_result(dsk, PWM_UNKNOWN);
+    else {
+      ata_powermode_result(dsk, PWM_ACTIVE);
+      if(desc[5] != 0xFF) {
+        dsk->ret = GETTEMP_DRIVE_SLEEP;
+        return 0;
+      }
+    }
+
+    if(sata_submit_cmd(dsk, values, SATA_STEP_VALUES) == 0)
+      return 1;
+    err = errno;
+  }
 
-  /* never reached */
+  snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", strerror(err));
+  dsk->caps = 0;
+  sg_release(dsk);
+  close(dsk->fd);
+  dsk->fd = -1;
+  dsk->ret = GETTEMP_ERROR;
+  return 0;
 }
 
 
@@ -202,5 +286,7 @@ struct bustype sata_bus = {
   "SATA",
   sata_probe,
   sata_model,
-  sata_get_temperature
+  sata_get_temperature,
+  sata_submit,
+  sata_complete
 };
@@ -50,13 +50,12 @@
 #define		ATA_16			0x85      /* 16-byte pass-thru */
 #endif
 
-int sata_pass_thru(int device, unsigned char *cmd, unsigned char *buffer) {
-  unsigned char cdb[16];
-  unsigned char sense[32];
+/* Fill the ATA PASS-THROUGH (16) CDB for a HDIO_DRIVE_CMD style cmd[4],
+   returning the SG_IO data direction. */
+int sata_build_cdb(unsigned char *cmd, unsigned char *cdb) {
   int dxfer_direction;
-  int ret;
-  
-  memset(cdb, 0, sizeof(cdb));
+
+  memset(cdb, 0, 16);
   cdb[0] = ATA_16;
   if (cmd[3]) {
     cdb[1] = (4 << 1); /* PIO Data-in */
@@ -78,6 +77,17 @@ int sata_pass_thru(int device, unsigned char *cmd, unsigned char *buffer) {
     cdb[6] = cmd[1];
   cdb[14] = cmd[0];
 
+  return dxfer_direction;
+}
+
+int sata_pass_thru(int device, unsigned char *cmd, unsigned char *buffer) {
+  unsigned char cdb[16];
+  unsigned char sense[32];
+  int dxfer_direction;
+  int ret;
+  
+  dxfer_direction = sata_build_cdb(cmd, cdb);
+
   ret = scsi_SG_IO(device, cdb, sizeof(cdb), buffer, cmd[3] * 512, sense, sizeof(sense), dxfer_direction);
 
   /* Verify SATA magic */
@@ -19,6 +19,7 @@
 #ifndef SATACMDS_H_
 #define SATACMDS_H_
 
+int sata_build_cdb(unsigned char *cmd, unsigned char *cdb);
 int sata_pass_thru(int device, unsigned char *cmd, unsigned char *buffer);
 void sata_fixstring(unsigned char *s, int bytecount);
 int sata_enable_smart(int device);
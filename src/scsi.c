@@ -47,6 +47,7 @@
 // Application specific includes
 #include "scsicmds.h"
 #include "hddtemp.h"
+#include "sgasync.h"
 
 static int scsi_probe(int device) {
   int bus_num;
@@ -69,16 +70,17 @@ static const char *scsi_model (int device) {
 
 static enum e_gettemp scsi_get_temperature(struct disk *dsk) {
   int              i;
-  int              tempPage = 0;
   unsigned char    buffer[1024];
 
   /*
     on triche un peu
   */
-  dsk->db_entry = (struct harddrive_entry*) malloc(sizeof(struct harddrive_entry));
   if(dsk->db_entry == NULL) {
-    perror("malloc");
-    exit(-1);
+    dsk->db_entry = (struct harddrive_entry*) malloc(sizeof(struct harddrive_entry));
+    if(dsk->db_entry == NULL) {
+      perror("malloc");
+      exit(-1);
+    }
   }
 
   dsk->db_entry->regexp       = "";
@@ -88,57 +90,97 @@ static enum e_gettemp scsi_get_temperature(struct disk *dsk) {
   dsk->db_entry->unit         = 'C';
   dsk->db_entry->next         = NULL;
 
-  if (scsi_smartsupport(dsk->fd) == 0) {
-    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("S.M.A.R.T. not available"));
-    close(dsk->fd);
-    dsk->fd = -1;
-    return GETTEMP_NOT_APPLICABLE;
+  /* the mode and supported pages are only looked at once, afterwards a
+     reading is a single LOG SENSE */
+  if(!(dsk->caps & CAP_SMART)) {
+    if (scsi_smartsupport(dsk->fd) == 0) {
+      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("S.M.A.R.T. not available"));
+      close(dsk->fd);
+      dsk->fd = -1;
+      return GETTEMP_NOT_APPLICABLE;
+    }
+
+    /*
+      Enable SMART
+    */
+    if (scsi_smartDEXCPTdisable(dsk->fd) != 0) {
+      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", strerror(errno));
+      close(dsk->fd);
+      dsk->fd = -1;
+      return GETTEMP_ERROR;
+    }
+
+    /*
+      Temp. capable
+    */
+    if (scsi_logsense(dsk->fd , SUPPORT_LOG_PAGES, buffer, sizeof(buffer)) != 0) {
+      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("log sense failed : %s"), strerror(errno));
+      close(dsk->fd);
+      dsk->fd = -1;
+      return GETTEMP_ERROR;
+    }
+
+    for ( i = 4; i < buffer[3] + LOGPAGEHDRSIZE ; i++) {
+      if (buffer[i] == TEMPERATURE_PAGE) {
+        dsk->caps |= CAP_TEMP_PAGE;
+        break;
+      }
+    }
+
+    dsk->caps |= CAP_SMART;
   }
 
-  /*
-    Enable SMART
-  */
-  if (scsi_smartDEXCPTdisable(dsk->fd) != 0) {
-    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, "%s", strerror(errno));
-    close(dsk->fd);
-    dsk->fd = -1;
-    return GETTEMP_ERROR;
+  if(dsk->caps & CAP_TEMP_PAGE) {
+    /*
+       get temperature (from scsiGetTemp (scsicmd.c))
+    */
+    if (scsi_logsense(dsk->fd , TEMPERATURE_PAGE, buffer, sizeof(buffer)) != 0) {
+      snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("log sense failed : %s"), strerror(errno));
+      dsk->caps = 0;
+      close(dsk->fd);
+      dsk->fd = -1;
+      return GETTEMP_ERROR;
+    }
+
+    dsk->value = buffer[9];
+
+    return GETTEMP_KNOWN;
+  } else {
+    return GETTEMP_NOSENSOR;
   }
+}
 
-  /*
-    Temp. capable
-  */
-  if (scsi_logsense(dsk->fd , SUPPORT_LOG_PAGES, buffer, sizeof(buffer)) != 0) {
-    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("log sense failed : %s"), strerror(errno));
+/* Once the temperature page is known to be there, a reading is a
+   single LOG SENSE that the daemon sends through the sg node. */
+static int scsi_submit(struct disk *dsk) {
+  unsigned char cdb[10];
+
+  if(!(dsk->caps & CAP_SMART) || !(dsk->caps & CAP_TEMP_PAGE) ||
+     sg_attach(dsk) == -1)
+    return -1;
+
+  dsk->value = -1;
+  scsi_logsense_cdb(TEMPERATURE_PAGE, cdb);
+  return sg_submit(dsk, cdb, sizeof(cdb), sizeof(dsk->sg->data), SG_DXFER_FROM_DEV);
+}
+
+static int scsi_complete(struct disk *dsk) {
+  struct sg_cmd * cmd = dsk->sg;
+
+  if(!sg_status_ok(cmd)) {
+    snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("log sense failed : %s"),
+             strerror(cmd->error ? cmd->error : EIO));
+    dsk->caps = 0;
+    sg_release(dsk);
     close(dsk->fd);
     dsk->fd = -1;
-    return GETTEMP_ERROR;
-   }
-
-   for ( i = 4; i < buffer[3] + LOGPAGEHDRSIZE ; i++) {
-     if (buffer[i] == TEMPERATURE_PAGE) {
-       tempPage = 1;
-       break;
-     }
-   }
-
-   if(tempPage) {
-      /*
-         get temperature (from scsiGetTemp (scsicmd.c))
-      */
-      if (scsi_logsense(dsk->fd , TEMPERATURE_PAGE, buffer, sizeof(buffer)) != 0) {
-        snprintf(dsk->errormsg, MAX_ERRORMSG_SIZE, _("log sense failed : %s"), strerror(errno));
-        close(dsk->fd);
-        dsk->fd = -1;
-        return GETTEMP_ERROR;
-      }
-
-      dsk->value = buffer[9];
+    dsk->ret = GETTEMP_ERROR;
+    return 0;
+  }
 
-      return GETTEMP_KNOWN;
-   } else {
-     return GETTEMP_NOSENSOR;
-   }
+  dsk->value = cmd->data[9];
+  dsk->ret = GETTEMP_KNOWN;
+  return 0;
 }
 
 /*******************************
@@ -148,5 +190,7 @@ struct bustype scsi_bus = {
   "SCSI",
   scsi_probe,
   scsi_model,
-  scsi_get_temperature
+  scsi_get_temperature,
+  scsi_submit,
+  scsi_complete
 };
@@ -152,6 +152,75 @@ int scsi_inquiry(int device, unsigned char *buffer)
   }
 }
 
+int scsi_inquiry_vpd(int device, unsigned char page, unsigned char *buffer, int buffer_len)
+{
+  unsigned char cdb[6];
+
+  memset(cdb, 0, sizeof(cdb));
+  cdb[0] = INQUIRY;
+  cdb[1] = 0x01;  /* EVPD */
+  cdb[2] = page;
+  cdb[3] = (buffer_len >> 8) & 0xff;
+  cdb[4] = buffer_len & 0xff;
+
+  memset(buffer, 0, buffer_len);
+  if (scsi_command(device, cdb, sizeof(cdb), buffer, buffer_len, SG_DXFER_FROM_DEV) != 0 ||
+      buffer[1] != page)
+    return 1;
+  else
+    return 0;
+}
+
+/* Identifier of the logical unit in a VPD page: from page 0x83 its NAA
+   designator, or else its EUI-64, as "naa.<hex>" or "eui.<hex>"; from
+   page 0x80 the unit serial number as is.  Returns 0 when one was
+   found. */
+int scsi_vpd_id(const unsigned char *vpd, int len, char *id, int id_len)
+{
+  const unsigned char *d, *best = NULL;
+  int off, n, i;
+
+  if (len < 4)
+    return 1;
+  if (vpd[2] * 256 + vpd[3] + 4 < len)
+    len = vpd[2] * 256 + vpd[3] + 4;
+
+  if (vpd[1] == 0x80) {
+    for (i = 4; i < len && vpd[i] == ' '; i++)
+      ;
+    for (n = len; n > i && (vpd[n - 1] == ' ' || vpd[n - 1] == '\0'); n--)
+      ;
+    if (n == i || n - i >= id_len)
+      return 1;
+    memcpy(id, vpd + i, n - i);
+    id[n - i] = '\0';
+    return 0;
+  }
+
+  if (vpd[1] != 0x83)
+    return 1;
+
+  for (off = 4; off + 4 <= len && off + 4 + vpd[off + 3] <= len; off += 4 + vpd[off + 3]) {
+    d = vpd + off;
+    if ((d[1] & 0x30) != 0)   /* association: not the logical unit */
+      continue;
+    if ((d[1] & 0x0f) == 3) { /* NAA */
+      best = d;
+      break;
+    }
+    if ((d[1] & 0x0f) == 2 && best == NULL)   /* EUI-64 */
+      best = d;
+  }
+
+  if (best == NULL || best[3] == 0 || 4 + 2 * best[3] >= id_len)
+    return 1;
+
+  n = sprintf(id, "%s.", (best[1] & 0x0f) == 3 ? "naa" : "eui");
+  for (i = 0; i < best[3]; i++)
+    n += sprintf(id + n, "%02x", best[4 + i]);
+  return 0;
+}
+
 int scsi_modesense(int device, unsigned char pagenum, unsigned char *buffer, int buffer_len) {
   unsigned char cdb[6];
   int ret;
@@ -185,13 +254,17 @@ int scsi_modeselect(int device, unsigned char *buffer) {
   return scsi_command(device, cdb, sizeof(cdb), buffer, cdb[4], SG_DXFER_TO_DEV);
 }
 
-int scsi_logsense(int device, int pagenum, unsigned char *buffer, int buffer_len) {
-  unsigned char cdb[10];
-
-  memset(cdb, 0, sizeof(cdb));
+void scsi_logsense_cdb(int pagenum, unsigned char *cdb) {
+  memset(cdb, 0, 10);
   cdb[0] = LOG_SENSE;
   cdb[2] = 0x40 | pagenum;
   cdb[7] = 0x04;
+}
+
+int scsi_logsense(int device, int pagenum, unsigned char *buffer, int buffer_len) {
+  unsigned char cdb[10];
+
+  scsi_logsense_cdb(pagenum, cdb);
 
   return scsi_command(device, cdb, sizeof(cdb), buffer, buffer_len, SG_DXFER_FROM_DEV);
 }
@@ -27,8 +27,11 @@
 
 int scsi_SG_IO(int device, unsigned char *cdb, int cdb_len, unsigned char *buffer, int buffer_len, unsigned char *sense, unsigned char sense_len, int dxfer_direction);
 int scsi_inquiry(int device, unsigned char *buffer);
+int scsi_inquiry_vpd(int device, unsigned char page, unsigned char *buffer, int buffer_len);
+int scsi_vpd_id(const unsigned char *vpd, int len, char *id, int id_len);
 int scsi_modesense(int device, unsigned char pagenum, unsigned char *buffer, int buffer_len);
 int scsi_modeselect(int device, unsigned char *buffer);
+void scsi_logsense_cdb(int pagenum, unsigned char *cdb);
 int scsi_logsense(int device, int pagenum, unsigned char *buffer, int buffer_len);
 int scsi_smartsupport(int device);
 int scsi_smartDEXCPTdisable(int device);
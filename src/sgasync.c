@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Asynchronous commands through the sg driver.  Writing a sg_io_hdr to
+ * /dev/sgN queues the command and returns at once, the reply is read
+ * back from the same node once it is ready.  The daemon uses this to
+ * send the steady-state reading of every drive in one go and collect
+ * the answers in whatever order the drives give them.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <scsi/sg.h>
+
+// Application specific includes
+#include "hddtemp.h"
+#include "sysfs.h"
+#include "sgasync.h"
+
+#define SG_TIMEOUT             3000    /* ms, as for the SG_IO ioctl */
+#define SG_REAP_TIMEOUT        (2 * SG_TIMEOUT)
+
+static int sg_open(int device) {
+  char            dir[PATH_MAX];
+  char            path[PATH_MAX];
+  DIR *           d;
+  struct dirent * de;
+  int             fd = -1;
+  int             version;
+
+  if(sysfs_block_dir(device, dir, sizeof(dir)) == -1)
+    return -1;
+
+  if((size_t) snprintf(path, sizeof(path), "%s/device/scsi_generic", dir) >= sizeof(path) ||
+     (d = opendir(path)) == NULL)
+    return -1;
+
+  while((de = readdir(d)) != NULL) {
+    if(strncmp(de->d_name, "sg", 2) == 0) {
+      snprintf(path, sizeof(path), "/dev/%s", de->d_name);
+      fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+      break;
+    }
+  }
+  closedir(d);
+
+  /* only the sg driver itself has the write/read interface */
+  if(fd != -1 && (ioctl(fd, SG_GET_VERSION_NUM, &version) == -1 || version < 30000)) {
+    close(fd);
+    fd = -1;
+  }
+
+  return fd;
+}
+
+/* Give the drive a sg node to send commands through.  Drives without
+   one are remembered so that the lookup isn't redone at every reading,
+   until the drive is reopened. */
+int sg_attach(struct disk *dsk) {
+  int fd;
+
+  if(dsk->sg)
+    return 0;
+
+  if(dsk->caps & CAP_NO_SG)
+    return -1;
+
+  if((fd = sg_open(dsk->fd)) == -1) {
+    dsk->caps |= CAP_NO_SG;
+    return -1;
+  }
+
+  dsk->sg = (struct sg_cmd *) calloc(1, sizeof(struct sg_cmd));
+  if(dsk->sg == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+  dsk->sg->fd = fd;
+
+  return 0;
+}
+
+/* Closing the node drops any reply still on its way. */
+void sg_release(struct disk *dsk) {
+  if(dsk->sg == NULL)
+    return;
+
+  close(dsk->sg->fd);
+  free(dsk->sg);
+  dsk->sg = NULL;
+}
+
+/* Queue a command on the node of the drive.  On failure the node is
+   released and -1 returned with errno set. */
+int sg_submit(struct disk *dsk, const unsigned char *cdb, int cdb_len, int data_len, int dxfer_direction) {
+  struct sg_cmd * cmd = dsk->sg;
+
+  memcpy(cmd->cdb, cdb, cdb_len);
+  memset(cmd->sense, 0, sizeof(cmd->sense));
+  memset(&cmd->io, 0, sizeof(cmd->io));
+  cmd->io.interface_id = 'S';
+  cmd->io.cmdp = cmd->cdb;
+  cmd->io.cmd_len = cdb_len;
+  cmd->io.dxferp = cmd->data;
+  cmd->io.dxfer_len = data_len;
+  cmd->io.dxfer_direction = dxfer_direction;
+  cmd->io.sbp = cmd->sense;
+  cmd->io.mx_sb_len = sizeof(cmd->sense);
+  cmd->io.timeout = SG_TIMEOUT;
+
+  /* a node that refuses commands is given up on like a missing one */
+  if(write(cmd->fd, &cmd->io, sizeof(cmd->io)) == -1) {
+    int err = errno;
+
+    sg_release(dsk);
+    dsk->caps |= CAP_NO_SG;
+    errno = err;
+    return -1;
+  }
+
+  cmd->error = 0;
+  cmd->pending = 1;
+  return 0;
+}
+
+/* The command completed with GOOD status. */
+int sg_status_ok(struct sg_cmd *cmd) {
+  return cmd->error == 0 && (cmd->io.info & SG_INFO_OK_MASK) == SG_INFO_OK;
+}
+
+/* Wait for the replies to the commands submitted on dsks, calling the
+   completion hook of the bus driver on each as it arrives and done()
+   once the hook has no further command to send.  Drives that stay
+   silent for SG_REAP_TIMEOUT are completed with ETIMEDOUT. */
+void sg_reap(struct disk **dsks, int n, void (*done)(struct disk *)) {
+  struct pollfd * pfds;
+  struct disk **  waiting;
+  int             nwaiting, i, r;
+
+  if(n == 0)
+    return;
+
+  pfds = (struct pollfd *) malloc(sizeof(struct pollfd) * n);
+  waiting = (struct disk **) malloc(sizeof(struct disk *) * n);
+  if(pfds == NULL || waiting == NULL) {
+    perror("malloc");
+    exit(-1);
+  }
+
+  while(1) {
+    nwaiting = 0;
+    for(i = 0; i < n; i++) {
+      if(dsks[i]->sg && dsks[i]->sg->pending) {
+        pfds[nwaiting].fd = dsks[i]->sg->fd;
+        pfds[nwaiting].events = POLLIN;
+        pfds[nwaiting].revents = 0;
+        waiting[nwaiting++] = dsks[i];
+      }
+    }
+
+    if(nwaiting == 0)
+      break;
+
+    r = poll(pfds, nwaiting, SG_REAP_TIMEOUT);
+    if(r == -1 && errno == EINTR)
+      continue;
+
+    for(i = 0; i < nwaiting; i++) {
+      struct disk *   dsk = waiting[i];
+      struct sg_cmd * cmd = dsk->sg;
+
+      if(r <= 0)
+        cmd->error = (r == 0) ? ETIMEDOUT : errno;
+      else if(pfds[i].revents == 0)
+        continue;
+      else if(read(cmd->fd, &cmd->io, sizeof(cmd->io)) == -1) {
+        if(errno == EAGAIN)
+          continue;
+        cmd->error = errno;
+      }
+
+      cmd->pending = 0;
+      if(bus[dsk->type]->complete(dsk) == 0)
+        done(dsk);
+    }
+  }
+
+  free(waiting);
+  free(pfds);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SGASYNC_H__
+#define __SGASYNC_H__
+
+#include <scsi/sg.h>
+
+/* One outstanding command on the sg node of a drive.  A drive has at
+   most one in flight; the bus driver may chain a follow-up command
+   from its completion hook, remembering where it is in step. */
+struct sg_cmd {
+  int               fd;           /* /dev/sgN of the drive */
+  int               pending;
+  int               error;        /* errno when no reply could be read */
+  int               step;
+  struct sg_io_hdr  io;
+  unsigned char     cdb[16];
+  unsigned char     sense[32];
+  unsigned char     data[1024];
+};
+
+struct disk;
+
+int sg_attach(struct disk *dsk);
+void sg_release(struct disk *dsk);
+int sg_submit(struct disk *dsk, const unsigned char *cdb, int cdb_len, int data_len, int dxfer_direction);
+int sg_status_ok(struct sg_cmd *cmd);
+void sg_reap(struct disk **dsks, int n, void (*done)(struct disk *));
+
+#endif
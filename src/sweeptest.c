@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests of the sampler's scheduling, with fake drives and a simulated
+   clock: the namespaces of an NVMe controller must keep sharing one
+   reading in every sweep, not only in the first one.
+
+   daemon.c is included to reach its static functions, and what
+   hddtemp.c provides is replaced by the little the sampler needs.  Run
+   by "make check". */
+
+#include "daemon.c"
+
+/*******************************************************
+ * What hddtemp.c provides
+ *******************************************************/
+
+struct bustype *   bus[BUS_TYPE_MAX];
+int                hotplug, no_tcp, tcp_daemon, af_hint, foreground;
+char               separator = '|';
+enum e_format      output_format = FORMAT_TEXT;
+long               portnum, syslog_interval, poll_workers = 1, listen_backlog;
+long               adaptive_min, adaptive_max, metrics_port, unix_mode;
+char *             database_path = NULL;
+char *             database_dir = NULL;
+char *             listen_addr = NULL;
+char *             unix_path = NULL;
+char *             sysfs_root = "/sys";
+char *             uevent_path = NULL;
+char **            include_patterns = NULL;
+char **            exclude_patterns = NULL;
+
+int value_to_unit(struct disk *dsk) {
+  return dsk->value;
+}
+
+char get_unit(struct disk *dsk) {
+  (void) dsk;
+  return 'C';
+}
+
+const char *gettemp_name(enum e_gettemp ret) {
+  return ret == GETTEMP_KNOWN ? "ok" : "error";
+}
+
+void disk_json(struct buffer *out, struct disk *dsk) {
+  (void) out;
+  (void) dsk;
+}
+
+void disk_lookup(struct disk *dsk) {
+  (void) dsk;
+}
+
+int disk_failover(struct disk *dsk) {
+  (void) dsk;
+  return 0;
+}
+
+void set_interval(struct disk *dsk) {
+  (void) dsk;
+}
+
+/*******************************************************
+ * Fake drives
+ *******************************************************/
+
+#define NDISKS                 4
+#define SECOND                 1000
+
+static struct disk   test_disks[NDISKS];
+static int           reads[NDISKS];         /* commands sent to each drive */
+static struct disk * fail_next = NULL;      /* drive whose next reading fails */
+
+int disk_open(struct disk *dsk) {
+  dsk->fd = 100 + (dsk - test_disks);
+  dsk->type = BUS_NVME;
+  return 0;
+}
+
+static enum e_gettemp fake_get_temperature(struct disk *dsk) {
+  reads[dsk - test_disks]++;
+
+  if(dsk == fail_next) {
+    fail_next = NULL;
+    dsk->fd = -1;
+    return GETTEMP_ERROR;
+  }
+
+  dsk->value = 40;
+  return GETTEMP_KNOWN;
+}
+
+static struct bustype fake_bus = {
+  "FAKE",
+  NULL,
+  NULL,
+  fake_get_temperature,
+  NULL,
+  NULL
+};
+
+/*******************************************************
+ * Tests
+ *******************************************************/
+
+static int failed = 0;
+
+#define CHECK(cond) do {                                              \
+    if(!(cond)) {                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failed = 1;                                                     \
+    }                                                                 \
+  } while(0)
+
+/* nvme0n1 and nvme0n2 share a controller, at different intervals so
+   that they would drift apart if scheduled on their own */
+static void setup(void) {
+  static const char * names[NDISKS] = { "nvme0n1", "nvme0n2", "nvme1n1", "sda" };
+  static const char * controllers[NDISKS] = { "nvme0", "nvme0", "nvme1", NULL };
+  static const long   intervals[NDISKS] = { 10, 7, 10, 13 };
+  int                 i;
+
+  bus[BUS_NVME] = &fake_bus;
+  poller = pool_create(1);
+
+  memset(test_disks, 0, sizeof(test_disks));
+  for(i = 0; i < NDISKS; i++) {
+    test_disks[i].drive = names[i];
+    test_disks[i].controller = controllers[i];
+    test_disks[i].interval = intervals[i];
+    disk_open(&test_disks[i]);
+    test_disks[i].next = (i + 1 < NDISKS) ? &test_disks[i + 1] : NULL;
+  }
+  disks = test_disks;
+  ndisks = NDISKS;
+  due_disks = (struct disk **) malloc(sizeof(struct disk *) * NDISKS);
+  for(i = 0; i < NDISKS; i++)
+    due_disks[i] = &test_disks[i];
+}
+
+/* Run the sampler from "from" to "to", returning how many times each
+   drive was due. */
+static void run(long from, long to, int *due) {
+  long now;
+  int  i, n, log_due;
+
+  memset(due, 0, NDISKS * sizeof(int));
+  memset(reads, 0, sizeof(reads));
+  for(now = from; now < to; now += 100) {
+    n = daemon_sweep(now, &log_due);
+    for(i = 0; i < n; i++)
+      due[due_disks[i] - test_disks]++;
+  }
+}
+
+int main(void) {
+  int  due[NDISKS];
+  long start;
+  int  i;
+
+  setup();
+
+  /* the first readings, before the timers are armed */
+  daemon_update(due_disks, NDISKS);
+  CHECK(reads[0] == 1 && reads[1] == 0);
+  CHECK(test_disks[1].value == 40 && test_disks[1].ret == GETTEMP_KNOWN);
+
+  wheel_init();
+  start = wheel_now();
+  daemon_start_timers(start);
+
+  /* the namespaces come due together, the controller is asked once */
+  memset(reads, 0, sizeof(reads));
+  run(start, start + 300 * SECOND, due);
+  CHECK(due[0] == 30 && due[1] == due[0]);
+  CHECK(reads[0] == due[0] && reads[1] == 0);
+  CHECK(due[2] == 30 && reads[2] == due[2]);
+  CHECK(due[3] == 23 && reads[3] == due[3]);
+
+  /* while nvme0n1 is being reopened nvme0n2 reads the controller on its
+     own, then follows nvme0n1 again */
+  start += 300 * SECOND;
+  fail_next = &test_disks[0];
+  run(start, start + 100 * SECOND, due);
+  CHECK(test_disks[0].fd != -1 && test_disks[0].failures == 0);
+  CHECK(reads[1] > 0);
+
+  start += 100 * SECOND;
+  run(start, start + 300 * SECOND, due);
+  CHECK(due[1] == due[0] && reads[1] == 0);
+
+  for(i = 0; i < NDISKS; i++)
+    CHECK(test_disks[i].leader == NULL);
+
+  pool_destroy(poller);
+  free(due_disks);
+
+  if(!failed)
+    printf("sweeptest: ok\n");
+  return failed;
+}
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _GNU_SOURCE
+
+/*
+ * Helpers to find what the kernel exports in sysfs about a block device.
+ * Every path is built under sysfs_root, so that a fake tree can stand in
+ * for /sys.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+// Application specific includes
+#include "hddtemp.h"
+#include "sysfs.h"
+#include "scsicmds.h"
+
+/* Directory of the block device open on a descriptor, as in
+   /sys/dev/block/MAJOR:MINOR.  Returns -1 if it is not a block device. */
+int sysfs_block_dir(int device, char *path, size_t size) {
+  struct stat st;
+
+  if(fstat(device, &st) == -1)
+    return -1;
+
+  if(!S_ISBLK(st.st_mode)) {
+    errno = ENOTBLK;
+    return -1;
+  }
+
+  if((size_t) snprintf(path, size, "%s/dev/block/%u:%u", sysfs_root,
+                       major(st.st_rdev), minor(st.st_rdev)) >= size) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Read a sysfs attribute without its trailing blanks and newline.
+   Returns its length, or -1. */
+int sysfs_read(const char *path, char *buf, size_t size) {
+  int     fd;
+  ssize_t n;
+
+  fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return -1;
+
+  n = read(fd, buf, size - 1);
+  close(fd);
+  if(n < 0)
+    return -1;
+
+  while(n > 0 && (buf[n - 1] == '\n' || buf[n - 1] == ' '))
+    n--;
+  buf[n] = '\0';
+
+  return n;
+}
+
+/* Whether the SCSI device of the block device dir sits on a SCSI
+   transport (SAS, Fibre Channel, iSCSI), as seen from its path in the
+   device tree, rather than behind a USB or other bridge. */
+static int sysfs_native_scsi(const char *dir) {
+  char  path[PATH_MAX + 32];
+  char  real[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/device", dir);
+  if(realpath(path, real) == NULL || strstr(real, "/usb") != NULL)
+    return 0;
+
+  return strstr(real, "/end_device-") != NULL ||   /* SAS */
+         strstr(real, "/rport-") != NULL ||        /* Fibre Channel */
+         strstr(real, "/session") != NULL;         /* iSCSI */
+}
+
+/* Name of the subsystem of the device behind the block device dir, in
+   link.  Returns NULL if it has none. */
+static const char *sysfs_subsystem(const char *dir, char *link, size_t size) {
+  char  path[PATH_MAX + 32];
+  char *subsystem;
+  int   n;
+
+  snprintf(path, sizeof(path), "%s/device/subsystem", dir);
+  n = readlink(path, link, size - 1);
+  if(n == -1)
+    return NULL;
+  link[n] = '\0';
+
+  subsystem = strrchr(link, '/');
+  return subsystem ? subsystem + 1 : link;
+}
+
+static enum e_bustype sysfs_dir_bus_type(const char *dir) {
+  char        path[PATH_MAX + 32];
+  char        link[PATH_MAX];
+  char        vendor[16];
+  const char *subsystem;
+
+  subsystem = sysfs_subsystem(dir, link, sizeof(link));
+  if(subsystem == NULL)
+    return BUS_UNKNOWN;
+
+  /* libata reports every ATA disk with the "ATA" vendor, whatever the
+     drive's make.  Other vendors are only conclusive on a native SCSI
+     transport: USB bridges report the enclosure's vendor, and many of
+     them pass ATA commands through, so they are left to the probes. */
+  if(strcmp(subsystem, "scsi") == 0) {
+    snprintf(path, sizeof(path), "%s/device/vendor", dir);
+    if(sysfs_read(path, vendor, sizeof(vendor)) == -1)
+      return BUS_UNKNOWN;
+
+    if(strcmp(vendor, "ATA") == 0)
+      return BUS_SATA;
+
+    return sysfs_native_scsi(dir) ? BUS_SCSI : BUS_UNKNOWN;
+  }
+
+  if(strcmp(subsystem, "ide") == 0)
+    return BUS_ATA;
+
+#ifdef HAVE_LINUX_NVME_IOCTL_H
+  /* namespaces hang off their controller, or off the subsystem with
+     native multipathing */
+  if(strcmp(subsystem, "nvme") == 0 || strcmp(subsystem, "nvme-subsystem") == 0)
+    return BUS_NVME;
+#endif
+
+  return BUS_UNKNOWN;
+}
+
+/* Bus type of a block device from what its driver tells sysfs, so that
+   the usual case needs no trial command.  Returns BUS_UNKNOWN when sysfs
+   can't tell, and the caller then falls back on probing. */
+enum e_bustype sysfs_bus_type(int device) {
+  char dir[PATH_MAX];
+
+  if(sysfs_block_dir(device, dir, sizeof(dir)) == -1)
+    return BUS_UNKNOWN;
+
+  return sysfs_dir_bus_type(dir);
+}
+
+static int sysfs_read_raw(const char *path, unsigned char *buf, size_t size) {
+  int     fd;
+  ssize_t n;
+
+  fd = open(path, O_RDONLY);
+  if(fd == -1)
+    return -1;
+
+  n = read(fd, buf, size);
+  close(fd);
+
+  return n;
+}
+
+/* Name of the drive behind the block device whose sysfs directory is
+   dir, the same for every path leading to it: the kernel's wwid (NVMe
+   EUI/NGUID, or the SCSI VPD page 0x83 designator), the designator
+   itself on older kernels, or else the model and serial number.
+   Returns a malloc()ed string, or NULL. */
+char *sysfs_identity(const char *dir) {
+  char          path[PATH_MAX + 32];
+  char          id[256];
+  char          model[64];
+  unsigned char vpd[256];
+  int           n;
+
+  snprintf(path, sizeof(path), "%s/wwid", dir);
+  if(sysfs_read(path, id, sizeof(id)) > 0)
+    return strdup(id);
+
+  snprintf(path, sizeof(path), "%s/device/wwid", dir);
+  if(sysfs_read(path, id, sizeof(id)) > 0)
+    return strdup(id);
+
+  snprintf(path, sizeof(path), "%s/device/vpd_pg83", dir);
+  if((n = sysfs_read_raw(path, vpd, sizeof(vpd))) > 0 &&
+     scsi_vpd_id(vpd, n, id, sizeof(id)) == 0)
+    return strdup(id);
+
+  /* libata fills page 0x80 with the ATA IDENTIFY serial number */
+  snprintf(path, sizeof(path), "%s/device/vpd_pg80", dir);
+  if((n = sysfs_read_raw(path, vpd, sizeof(vpd))) > 0 &&
+     scsi_vpd_id(vpd, n, id, sizeof(id)) == 0) {
+    char *p;
+
+    snprintf(path, sizeof(path), "%s/device/model", dir);
+    if(sysfs_read(path, model, sizeof(model)) < 0)
+      model[0] = '\0';
+    if(asprintf(&p, "serial.%s.%s", model, id) == -1)
+      return NULL;
+    return p;
+  }
+
+  return NULL;
+}
+
+/* The device a block device hangs off, resolved so that the namespaces
+   of one NVMe controller give the same string.  Returns a malloc()ed
+   path, or NULL. */
+char *sysfs_device(int device) {
+  char dir[PATH_MAX];
+  char path[PATH_MAX];
+
+  if(sysfs_block_dir(device, dir, sizeof(dir)) == -1)
+    return NULL;
+
+  if((size_t) snprintf(path, sizeof(path), "%s/device", dir) >= sizeof(path))
+    return NULL;
+
+  return realpath(path, NULL);
+}
+
+static int sysfs_match(char **patterns, const char *name) {
+  for(; patterns && *patterns; patterns++)
+    if(fnmatch(*patterns, name, 0) == 0)
+      return 1;
+
+  return 0;
+}
+
+static int sysfs_is(const char *dir, const char *attr, const char *value) {
+  char path[PATH_MAX + 32];
+  char buf[16];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, attr);
+  return sysfs_read(path, buf, sizeof(buf)) != -1 && strcmp(buf, value) == 0;
+}
+
+/* sda < sdz < sdaa, nvme2n1 < nvme10n1 */
+static int sysfs_compare(const void *a, const void *b) {
+  const char *sa = *(const char **) a;
+  const char *sb = *(const char **) b;
+  size_t      la = strlen(sa), lb = strlen(sb);
+
+  if(la != lb && strspn(sa, "abcdefghijklmnopqrstuvwxyz") == la
+     && strspn(sb, "abcdefghijklmnopqrstuvwxyz") == lb)
+    return la < lb ? -1 : 1;
+
+  return strverscmp(sa, sb);
+}
+
+/* Whether the block device called name in /sys/block is a disk hddtemp
+   has a bus for.  Partitions are not listed there, and the virtual
+   devices (loop, dm, md, zram...) have no device behind them; optical
+   drives, removable media and hidden multipath paths are left out.
+   Only names matching one of the include patterns, if any, and none of
+   the exclude patterns are kept.  Nothing is opened. */
+int sysfs_disk_wanted(const char *name, char **include, char **exclude) {
+  char        dir[PATH_MAX];
+  char        link[PATH_MAX];
+  const char *subsystem;
+
+  if(include && *include && !sysfs_match(include, name))
+    return 0;
+  if(sysfs_match(exclude, name))
+    return 0;
+
+  snprintf(dir, sizeof(dir), "%s/block/%s", sysfs_root, name);
+  if(sysfs_is(dir, "removable", "1") || sysfs_is(dir, "hidden", "1"))
+    return 0;
+
+  /* any SCSI disk or reduced block command device, not CD-ROMs or
+     tapes, whatever its vendor and transport: disks behind USB bridges
+     or RAID controllers have their bus type probed once opened */
+  subsystem = sysfs_subsystem(dir, link, sizeof(link));
+  if(subsystem && strcmp(subsystem, "scsi") == 0)
+    return sysfs_is(dir, "device/type", "0") || sysfs_is(dir, "device/type", "14");
+
+  return sysfs_dir_bus_type(dir) != BUS_UNKNOWN;
+}
+
+/* Drives to read when none is given on the command line, so this stays
+   cheap with thousands of devices.  Returns a NULL-terminated and sorted
+   list of device paths. */
+char **sysfs_list_disks(char **include, char **exclude) {
+  char           dir[PATH_MAX];
+  char **        list = NULL;
+  DIR *          d;
+  struct dirent *de;
+  int            i, n = 0;
+
+  snprintf(dir, sizeof(dir), "%s/block", sysfs_root);
+  d = opendir(dir);
+  if(d != NULL) {
+    while((de = readdir(d)) != NULL) {
+      if(de->d_name[0] == '.')
+        continue;
+      if(!sysfs_disk_wanted(de->d_name, include, exclude))
+        continue;
+
+      list = realloc(list, (n + 2) * sizeof(char *));
+      if(list == NULL) {
+        perror("realloc");
+        exit(-1);
+      }
+      list[n++] = strdup(de->d_name);
+    }
+    closedir(d);
+  }
+
+  if(n == 0)
+    return NULL;
+
+  qsort(list, n, sizeof(char *), sysfs_compare);
+
+  /* cciss!c0d0 is /dev/cciss/c0d0 */
+  for(i = 0; i < n; i++) {
+    char *p;
+
+    for(p = list[i]; *p; p++)
+      if(*p == '!')
+        *p = '/';
+    if(asprintf(&p, "/dev/%s", list[i]) == -1) {
+      perror("asprintf");
+      exit(-1);
+    }
+    free(list[i]);
+    list[i] = p;
+  }
+  list[n] = NULL;
+
+  return list;
+}
+
+void sysfs_free_list(char **list) {
+  char **p;
+
+  for(p = list; p && *p; p++)
+    free(*p);
+  free(list);
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SYSFS_H__
+#define __SYSFS_H__
+
+#include <stddef.h>
+
+int sysfs_block_dir(int device, char *path, size_t size);
+int sysfs_read(const char *path, char *buf, size_t size);
+enum e_bustype sysfs_bus_type(int device);
+char *sysfs_device(int device);
+char *sysfs_identity(const char *dir);
+int sysfs_disk_wanted(const char *name, char **include, char **exclude);
+char **sysfs_list_disks(char **include, char **exclude);
+void sysfs_free_list(char **list);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests of the drive autodetection, against a fake sysfs tree: the
+   disks are listed whatever their transport, and optical drives and
+   removable media are not.  Run by "make check". */
+
+#define _GNU_SOURCE
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/stat.h>
+
+// Application specific includes
+#include "hddtemp.h"
+#include "sysfs.h"
+
+char *               sysfs_root;
+
+static int           failed = 0;
+
+#define CHECK(cond) do {                                              \
+    if(!(cond)) {                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failed = 1;                                                     \
+    }                                                                 \
+  } while(0)
+
+/*******************************************************
+ * The fake tree
+ *******************************************************/
+
+static void make_dirs(const char *path) {
+  char  buf[PATH_MAX];
+  char *p;
+
+  snprintf(buf, sizeof(buf), "%s", path);
+  for(p = buf + 1; *p; p++) {
+    if(*p == '/') {
+      *p = '\0';
+      mkdir(buf, 0755);
+      *p = '/';
+    }
+  }
+  mkdir(buf, 0755);
+}
+
+static void make_file(const char *dir, const char *name, const char *content) {
+  char  path[PATH_MAX];
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  f = fopen(path, "w");
+  if(f == NULL) {
+    perror(path);
+    exit(1);
+  }
+  fprintf(f, "%s\n", content);
+  fclose(f);
+}
+
+static void make_link(const char *target, const char *dir, const char *name) {
+  char path[PATH_MAX];
+
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if(symlink(target, path) == -1) {
+    perror(path);
+    exit(1);
+  }
+}
+
+/* A block device "name" of the SCSI device at devpath, linked from
+   /sys/block as the kernel does. */
+static void make_scsi_disk(const char *name, const char *devpath, const char *vendor,
+                           const char *type, const char *removable) {
+  char dev[PATH_MAX], blk[PATH_MAX + 64], path[PATH_MAX + 64];
+
+  snprintf(dev, sizeof(dev), "%s/devices/%s", sysfs_root, devpath);
+  snprintf(blk, sizeof(blk), "%s/block/%s", dev, name);
+  make_dirs(blk);
+
+  snprintf(path, sizeof(path), "%s/bus/scsi", sysfs_root);
+  make_link(path, dev, "subsystem");
+  make_file(dev, "vendor", vendor);
+  make_file(dev, "type", type);
+
+  make_link("../..", blk, "device");
+  make_file(blk, "removable", removable);
+
+  snprintf(path, sizeof(path), "%s/block", sysfs_root);
+  make_link(blk, path, name);
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw) {
+  (void) st;
+  (void) flag;
+  (void) ftw;
+  return remove(path);
+}
+
+/*******************************************************
+ * Tests
+ *******************************************************/
+
+int main(void) {
+  char   root[] = "/tmp/sysfstest.XXXXXX";
+  char   path[PATH_MAX];
+  char * exclude[] = { "sdb", NULL };
+  char **list;
+  int    n;
+
+  if(mkdtemp(root) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  sysfs_root = root;
+
+  snprintf(path, sizeof(path), "%s/bus/scsi", root);
+  make_dirs(path);
+  snprintf(path, sizeof(path), "%s/block", root);
+  make_dirs(path);
+
+  /* a SATA disk in a USB enclosure, a SAS disk, a CD-ROM, a card reader
+     and a loop device */
+  make_scsi_disk("sdb", "pci0000:00/0000:00:14.0/usb2/2-1/2-1:1.0/host6/target6:0:0/6:0:0:0",
+                 "JMicron", "0", "0");
+  make_scsi_disk("sdc", "pci0000:00/0000:01:00.0/host0/port-0:0/end_device-0:0/target0:0:0/0:0:0:0",
+                 "SEAGATE", "0", "0");
+  make_scsi_disk("sr0", "pci0000:00/0000:00:17.0/ata1/host1/target1:0:0/1:0:0:0",
+                 "HL-DT-ST", "5", "1");
+  make_scsi_disk("sdd", "pci0000:00/0000:00:14.0/usb2/2-2/2-2:1.0/host7/target7:0:0/7:0:0:0",
+                 "Generic", "0", "1");
+  snprintf(path, sizeof(path), "%s/devices/virtual/block/loop0", root);
+  make_dirs(path);
+  make_file(path, "removable", "0");
+  make_link(path, root, "block/loop0");
+
+  list = sysfs_list_disks(NULL, NULL);
+  for(n = 0; list && list[n]; n++)
+    ;
+  CHECK(n == 2);
+  CHECK(n > 0 && strcmp(list[0], "/dev/sdb") == 0);
+  CHECK(n > 1 && strcmp(list[1], "/dev/sdc") == 0);
+  sysfs_free_list(list);
+
+  /* and --exclude still applies to them */
+  list = sysfs_list_disks(NULL, exclude);
+  CHECK(list && list[0] && strcmp(list[0], "/dev/sdc") == 0 && list[1] == NULL);
+  sysfs_free_list(list);
+
+  nftw(root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+  if(!failed)
+    printf("sysfstest: ok\n");
+  return failed;
+}
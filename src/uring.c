@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Passthrough commands through a raw io_uring (IORING_OP_URING_CMD).
+ * The sampler queues one command per drive, hands the whole batch to
+ * the kernel with a single io_uring_enter() and then collects the
+ * completions together, instead of one blocking ioctl per drive.
+ * Only the sampler thread uses the ring.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// Application specific includes
+#include "hddtemp.h"
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#define URING_ENTRIES          64
+#define URING_TIMEOUT          6000    /* ms without any completion */
+#define URING_SQE_SIZE         (2 * sizeof(struct io_uring_sqe))   /* IORING_SETUP_SQE128 */
+#define URING_CQE_SIZE         (2 * sizeof(struct io_uring_cqe))   /* IORING_SETUP_CQE32 */
+
+/* the kernel interface, which the tests replace with a fake ring */
+#ifndef URING_SYSCALL
+#define URING_SYSCALL          syscall
+#define URING_MMAP             mmap
+#endif
+
+static struct {
+  int               fd;
+  unsigned int *    sq_tail;
+  unsigned int *    sq_mask;
+  unsigned int *    sq_array;
+  unsigned int *    cq_head;
+  unsigned int *    cq_tail;
+  unsigned int *    cq_mask;
+  char *            sqes;
+  char *            cqes;
+  unsigned int      sq_entries;
+  unsigned int      cq_entries;
+  unsigned int      queued;       /* filled in but not yet submitted */
+  unsigned int      inflight;     /* submitted or queued, not completed,
+                                     released or not */
+} ring;
+static int ring_state = 0;        /* 1 once set up, -1 if unavailable */
+
+static int uring_enter(unsigned int to_submit, unsigned int min_complete, long timeout) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec      ts;
+  unsigned int                  flags = 0;
+
+  memset(&arg, 0, sizeof(arg));
+  if(min_complete) {
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+    arg.ts = (uint64_t) (uintptr_t) &ts;
+    flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+  }
+
+  return URING_SYSCALL(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags,
+                       min_complete ? &arg : NULL, min_complete ? sizeof(arg) : 0);
+}
+
+static int uring_init(void) {
+  struct io_uring_params p;
+  size_t                 size, cq_size;
+  char *                 sq;
+
+  if(ring_state)
+    return ring_state;
+  ring_state = -1;
+
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+  if((ring.fd = URING_SYSCALL(__NR_io_uring_setup, URING_ENTRIES, &p)) == -1)
+    return -1;
+
+  /* URING_CMD came after both of these, so they are only missing when
+     the kernel can't pass commands through anyway */
+  if(!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_EXT_ARG)) {
+    close(ring.fd);
+    return -1;
+  }
+
+  size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  cq_size = p.cq_off.cqes + p.cq_entries * URING_CQE_SIZE;
+  if(cq_size > size)
+    size = cq_size;
+
+  sq = URING_MMAP(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring.fd, IORING_OFF_SQ_RING);
+  if(sq == MAP_FAILED) {
+    close(ring.fd);
+    return -1;
+  }
+
+  ring.sqes = URING_MMAP(NULL, p.sq_entries * URING_SQE_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if(ring.sqes == MAP_FAILED) {
+    munmap(sq, size);
+    close(ring.fd);
+    return -1;
+  }
+
+  fcntl(ring.fd, F_SETFD, FD_CLOEXEC);
+  ring.sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+  ring.sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+  ring.sq_array = (unsigned int *) (sq + p.sq_off.array);
+  ring.cq_head = (unsigned int *) (sq + p.cq_off.head);
+  ring.cq_tail = (unsigned int *) (sq + p.cq_off.tail);
+  ring.cq_mask = (unsigned int *) (sq + p.cq_off.ring_mask);
+  ring.cqes = sq + p.cq_off.cqes;
+  ring.sq_entries = p.sq_entries;
+  ring.cq_entries = p.cq_entries;
+
+  return ring_state = 1;
+}
+
+/* Open the node commands for the drive are sent to. */
+int uring_attach(struct disk *dsk, const char *path) {
+  int fd;
+
+  if(dsk->uring)
+    return 0;
+
+  if(uring_init() == -1)
+    return -1;
+
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+    return -1;
+
+  dsk->uring = (struct uring_cmd *) calloc(1, sizeof(struct uring_cmd));
+  if(dsk->uring == NULL) {
+    perror("calloc");
+    exit(-1);
+  }
+  dsk->uring->dsk = dsk;
+  dsk->uring->fd = fd;
+
+  return 0;
+}
+
+void uring_release(struct disk *dsk) {
+  struct uring_cmd *cmd = dsk->uring;
+
+  if(cmd == NULL)
+    return;
+
+  close(cmd->fd);
+  dsk->uring = NULL;
+
+  if(cmd->pending)
+    cmd->dsk = NULL;
+  else
+    free(cmd);
+}
+
+/* Queue cmd, at most 80 bytes, for the drive.  It is only handed to
+   the kernel by uring_flush() or uring_reap(). */
+int uring_submit(struct disk *dsk, unsigned int cmd_op, const void *cmd, size_t len) {
+  struct io_uring_sqe * sqe;
+  unsigned int          tail, idx;
+
+  if(ring_state != 1) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  /* every command must have room for its completion */
+  if(ring.inflight >= ring.cq_entries) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  if(ring.queued == ring.sq_entries)
+    uring_flush();
+  if(ring.queued == ring.sq_entries) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  tail = *ring.sq_tail;
+  idx = tail & *ring.sq_mask;
+  sqe = (struct io_uring_sqe *) (ring.sqes + idx * URING_SQE_SIZE);
+
+  memset(sqe, 0, URING_SQE_SIZE);
+  sqe->opcode = IORING_OP_URING_CMD;
+  sqe->fd = dsk->uring->fd;
+  sqe->cmd_op = cmd_op;
+  sqe->user_data = (uint64_t) (uintptr_t) dsk->uring;
+  memcpy(sqe->cmd, cmd, len);
+
+  ring.sq_array[idx] = idx;
+  __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  ring.queued++;
+  ring.inflight++;
+  dsk->uring->pending++;
+  return 0;
+}
+
+/* Hand every queued command to the kernel without waiting. */
+void uring_flush(void) {
+  int r;
+
+  while(ring_state == 1 && ring.queued > 0) {
+    r = uring_enter(ring.queued, 0, 0);
+    if(r == -1) {
+      if(errno == EINTR)
+        continue;
+      break;
+    }
+    ring.queued -= r;
+  }
+}
+
+static int uring_waiting(struct disk **dsks, int n) {
+  int i;
+
+  for(i = 0; i < n; i++)
+    if(dsks[i]->uring && dsks[i]->uring->pending)
+      return 1;
+
+  return 0;
+}
+
+static void uring_complete(struct uring_cmd *cmd, int res, void (*done)(struct disk *)) {
+  struct disk *dsk = cmd->dsk;
+
+  ring.inflight--;
+  cmd->pending--;
+
+  /* a released command was only kept for the kernel to finish with */
+  if(dsk == NULL) {
+    if(cmd->pending == 0)
+      free(cmd);
+    return;
+  }
+
+  cmd->res = res;
+  if(bus[dsk->type]->complete(dsk) == 0)
+    done(dsk);
+}
+
+/* Give up on the commands of dsks still in flight: they are completed
+   with -ETIMEDOUT and released, and keep their place in the completion
+   queue until the kernel is done with them. */
+static void uring_timeout(struct disk **dsks, int n, void (*done)(struct disk *)) {
+  struct disk *dsk;
+  int          i;
+
+  for(i = 0; i < n; i++) {
+    dsk = dsks[i];
+    if(dsk->uring == NULL || !dsk->uring->pending)
+      continue;
+
+    /* nothing the hook sends now would be waited for */
+    dsk->uring->res = -ETIMEDOUT;
+    if(bus[dsk->type]->complete(dsk) != 0)
+      dsk->ret = GETTEMP_UNKNOWN;
+    uring_release(dsk);
+    done(dsk);
+  }
+}
+
+/* Submit what is still queued and wait for the commands of dsks,
+   calling the completion hook of the bus driver on each and done()
+   once the hook has no further command to send.  When nothing completes
+   for URING_TIMEOUT the remaining ones are given up on.  Completions of
+   commands released earlier are collected on the way. */
+void uring_reap(struct disk **dsks, int n, void (*done)(struct disk *)) {
+  struct io_uring_cqe * cqe;
+  unsigned int          head, tail;
+  int                   r;
+
+  if(ring_state != 1)
+    return;
+
+  for(;;) {
+    head = *ring.cq_head;
+    tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+
+    for(; head != tail; head++) {
+      cqe = (struct io_uring_cqe *) (ring.cqes + (head & *ring.cq_mask) * URING_CQE_SIZE);
+      __atomic_store_n(ring.cq_head, head + 1, __ATOMIC_RELEASE);
+      uring_complete((struct uring_cmd *) (uintptr_t) cqe->user_data, cqe->res, done);
+    }
+
+    if(!uring_waiting(dsks, n))
+      return;
+
+    r = uring_enter(ring.queued, 1, URING_TIMEOUT);
+    if(r > 0)
+      ring.queued -= r;
+    if(r != -1 || errno == EINTR)
+      continue;
+
+    /* the commands still queued may never reach the kernel, and their
+       slots could be submitted in place of later ones: the ring is not
+       used anymore */
+    if(errno != ETIME) {
+      perror("io_uring_enter");
+      ring_state = -1;
+    }
+
+    uring_timeout(dsks, n, done);
+    return;
+  }
+}
+
+#else
+
+int uring_attach(struct disk *dsk, const char *path) {
+  (void) dsk;
+  (void) path;
+  errno = ENOSYS;
+  return -1;
+}
+
+void uring_release(struct disk *dsk) {
+  (void) dsk;
+}
+
+int uring_submit(struct disk *dsk, unsigned int cmd_op, const void *cmd, size_t len) {
+  (void) dsk;
+  (void) cmd_op;
+  (void) cmd;
+  (void) len;
+  errno = ENOSYS;
+  return -1;
+}
+
+void uring_flush(void) {
+}
+
+void uring_reap(struct disk **dsks, int n, void (*done)(struct disk *)) {
+  (void) dsks;
+  (void) n;
+  (void) done;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stddef.h>
+
+/* A passthrough command in flight on the io_uring of the sampler.  The
+   kernel writes the reply into data, so a command released while still
+   in flight is only freed once its completion comes back. */
+struct uring_cmd {
+  unsigned char     data[512];
+  struct disk *     dsk;          /* NULL once released */
+  int               fd;
+  int               pending;      /* operations the kernel hasn't completed */
+  int               res;          /* 0, a device status, or -errno */
+};
+
+struct disk;
+
+int uring_attach(struct disk *dsk, const char *path);
+void uring_release(struct disk *dsk);
+int uring_submit(struct disk *dsk, unsigned int cmd_op, const void *cmd, size_t len);
+void uring_flush(void);
+void uring_reap(struct disk **dsks, int n, void (*done)(struct disk *));
+
+#endif
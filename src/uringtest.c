@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Tests of the io_uring completion paths, against a fake kernel that
+   completes commands only when told to: commands given up on after a
+   timeout, and commands released while in flight, must keep their
+   place in the completion queue until the kernel is done with them and
+   then be freed, without reaching their drive.
+
+   uring.c is included with its kernel interface replaced.  Run by
+   "make check". */
+
+#define _GNU_SOURCE
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <stdarg.h>
+#include <sys/types.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+static long fake_syscall(long nr, ...);
+static void *fake_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
+
+#define URING_SYSCALL          fake_syscall
+#define URING_MMAP             fake_mmap
+#endif
+
+#include "uring.c"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <stddef.h>
+
+/*******************************************************
+ * The fake kernel
+ *******************************************************/
+
+#define FAKE_SQ_ENTRIES        URING_ENTRIES
+#define FAKE_CQ_ENTRIES        (2 * URING_ENTRIES)
+
+static struct {
+  unsigned int   sq_head, sq_tail, sq_mask;
+  unsigned int   sq_array[FAKE_SQ_ENTRIES];
+  unsigned int   cq_head, cq_tail, cq_mask;
+  unsigned char  cqes[FAKE_CQ_ENTRIES][URING_CQE_SIZE] __attribute__ ((aligned (8)));
+} fake_rings;
+static unsigned char fake_sqes[FAKE_SQ_ENTRIES][URING_SQE_SIZE] __attribute__ ((aligned (8)));
+
+static uint64_t      kernel[FAKE_CQ_ENTRIES];     /* user_data of the commands it holds */
+static int           nkernel = 0;
+static int           stalled = 0;                /* nothing completes when waited for */
+static int           enter_errno = 0;            /* the next wait fails with it */
+
+/* complete every command the kernel holds */
+static void fake_complete_all(int res) {
+  struct io_uring_cqe *cqe;
+  int                  i;
+
+  for(i = 0; i < nkernel; i++) {
+    cqe = (struct io_uring_cqe *) fake_rings.cqes[fake_rings.cq_tail & fake_rings.cq_mask];
+    cqe->user_data = kernel[i];
+    cqe->res = res;
+    cqe->flags = 0;
+    fake_rings.cq_tail++;
+  }
+  nkernel = 0;
+}
+
+static long fake_enter(unsigned int to_submit, unsigned int min_complete) {
+  struct io_uring_sqe *sqe;
+  unsigned int         submitted = 0;
+
+  while(submitted < to_submit && fake_rings.sq_head != fake_rings.sq_tail) {
+    sqe = (struct io_uring_sqe *) fake_sqes[fake_rings.sq_array[fake_rings.sq_head & fake_rings.sq_mask]];
+    kernel[nkernel++] = sqe->user_data;
+    fake_rings.sq_head++;
+    submitted++;
+  }
+  if(submitted || !min_complete)
+    return submitted;
+
+  if(enter_errno) {
+    errno = enter_errno;
+    enter_errno = 0;
+    return -1;
+  }
+
+  if(!stalled)
+    fake_complete_all(0);
+  if(fake_rings.cq_head == fake_rings.cq_tail) {
+    errno = ETIME;
+    return -1;
+  }
+  return 0;
+}
+
+static long fake_syscall(long nr, ...) {
+  struct io_uring_params *p;
+  va_list                 ap;
+  unsigned int            to_submit, min_complete;
+
+  va_start(ap, nr);
+  if(nr == __NR_io_uring_setup) {
+    va_arg(ap, unsigned int);
+    p = va_arg(ap, struct io_uring_params *);
+    va_end(ap);
+
+    p->features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG;
+    p->sq_entries = FAKE_SQ_ENTRIES;
+    p->cq_entries = FAKE_CQ_ENTRIES;
+    p->sq_off.tail = offsetof(typeof(fake_rings), sq_tail);
+    p->sq_off.ring_mask = offsetof(typeof(fake_rings), sq_mask);
+    p->sq_off.array = offsetof(typeof(fake_rings), sq_array);
+    p->cq_off.head = offsetof(typeof(fake_rings), cq_head);
+    p->cq_off.tail = offsetof(typeof(fake_rings), cq_tail);
+    p->cq_off.ring_mask = offsetof(typeof(fake_rings), cq_mask);
+    p->cq_off.cqes = offsetof(typeof(fake_rings), cqes);
+    fake_rings.sq_mask = FAKE_SQ_ENTRIES - 1;
+    fake_rings.cq_mask = FAKE_CQ_ENTRIES - 1;
+    return open("/dev/null", O_RDONLY);
+  }
+
+  if(nr == __NR_io_uring_enter) {
+    va_arg(ap, int);
+    to_submit = va_arg(ap, unsigned int);
+    min_complete = va_arg(ap, unsigned int);
+    va_end(ap);
+    return fake_enter(to_submit, min_complete);
+  }
+
+  va_end(ap);
+  errno = ENOSYS;
+  return -1;
+}
+
+static void *fake_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off) {
+  (void) addr;
+  (void) prot;
+  (void) flags;
+  (void) fd;
+
+  if(off == IORING_OFF_SQ_RING && len <= sizeof(fake_rings))
+    return &fake_rings;
+  if(off == IORING_OFF_SQES && len <= sizeof(fake_sqes))
+    return fake_sqes;
+  return MAP_FAILED;
+}
+
+/*******************************************************
+ * A bus driver reading through the ring
+ *******************************************************/
+
+struct bustype *     bus[BUS_TYPE_MAX];
+
+static int           hooked, finished;           /* completion hook and done() calls */
+static int           follow_up = 0;              /* the hook sends another command on a timeout */
+
+static int fake_bus_complete(struct disk *dsk) {
+  hooked++;
+
+  if(dsk->uring->res == -ETIMEDOUT && follow_up)
+    return uring_submit(dsk, 0, "", 1) == 0;
+
+  dsk->ret = (dsk->uring->res == 0) ? GETTEMP_KNOWN : GETTEMP_UNKNOWN;
+  return 0;
+}
+
+static struct bustype fake_bus = {
+  "FAKE",
+  NULL,
+  NULL,
+  NULL,
+  NULL,
+  fake_bus_complete
+};
+
+static void done(struct disk *dsk) {
+  (void) dsk;
+  finished++;
+}
+
+/*******************************************************
+ * Tests
+ *******************************************************/
+
+static int failed = 0;
+
+#define CHECK(cond) do {                                              \
+    if(!(cond)) {                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failed = 1;                                                     \
+    }                                                                 \
+  } while(0)
+
+static void submit(struct disk *dsk) {
+  if(dsk->uring == NULL)
+    CHECK(uring_attach(dsk, "/dev/null") == 0);
+  CHECK(uring_submit(dsk, 0, "", 1) == 0);
+}
+
+int main(void) {
+  struct disk       d[2], *dsks[2] = { &d[0], &d[1] };
+  struct uring_cmd *cmd, *cmd2;
+
+  memset(d, 0, sizeof(d));
+  d[0].type = d[1].type = BUS_NVME;
+  bus[BUS_NVME] = &fake_bus;
+
+  /* both answered in one go */
+  submit(&d[0]);
+  submit(&d[1]);
+  uring_flush();
+  hooked = finished = 0;
+  uring_reap(dsks, 2, done);
+  CHECK(hooked == 2 && finished == 2);
+  CHECK(d[0].ret == GETTEMP_KNOWN && d[1].ret == GETTEMP_KNOWN);
+  CHECK(d[0].uring && d[0].uring->pending == 0 && ring.inflight == 0);
+
+  /* nothing comes back: d[0] is given up on and released, its command
+     stays in flight */
+  stalled = 1;
+  submit(&d[0]);
+  cmd = d[0].uring;
+  hooked = finished = 0;
+  uring_reap(dsks, 1, done);
+  CHECK(hooked == 1 && finished == 1 && d[0].ret == GETTEMP_UNKNOWN);
+  CHECK(d[0].uring == NULL && cmd->dsk == NULL && cmd->pending == 1);
+  CHECK(ring.inflight == 1);
+
+  /* its late completion, collected along with the next reading, is
+     not handed to the drive */
+  stalled = 0;
+  submit(&d[0]);
+  hooked = finished = 0;
+  uring_reap(dsks, 1, done);
+  CHECK(hooked == 1 && finished == 1 && d[0].ret == GETTEMP_KNOWN);
+  CHECK(ring.inflight == 0);
+
+  /* released while in flight, the drive being reopened: the completion
+     is collected even though nobody waits for it anymore */
+  submit(&d[1]);
+  uring_flush();
+  cmd = d[1].uring;
+  uring_release(&d[1]);
+  CHECK(d[1].uring == NULL && cmd->dsk == NULL && cmd->pending == 1);
+  fake_complete_all(0);
+  hooked = finished = 0;
+  uring_reap(dsks, 0, done);
+  CHECK(hooked == 0 && finished == 0 && ring.inflight == 0);
+
+  /* a hook sending another command on a timeout: the drive is still
+     done with, and the command only freed once both are completed */
+  stalled = 1;
+  follow_up = 1;
+  submit(&d[0]);
+  cmd = d[0].uring;
+  hooked = finished = 0;
+  uring_reap(dsks, 1, done);
+  CHECK(hooked == 1 && finished == 1 && d[0].ret == GETTEMP_UNKNOWN);
+  CHECK(d[0].uring == NULL && cmd->pending == 2 && ring.inflight == 2);
+  uring_flush();
+  fake_complete_all(-EIO);
+  uring_reap(dsks, 0, done);
+  CHECK(hooked == 1 && ring.inflight == 0);
+  stalled = 0;
+  follow_up = 0;
+
+  /* a failing ring is given up, the drives go back to their ioctls */
+  submit(&d[0]);
+  submit(&d[1]);
+  cmd = d[0].uring;
+  cmd2 = d[1].uring;
+  uring_flush();
+  enter_errno = EBADF;
+  hooked = finished = 0;
+  fprintf(stderr, "uringtest: an io_uring_enter error is expected:\n");
+  uring_reap(dsks, 2, done);
+  CHECK(hooked == 2 && finished == 2 && ring_state == -1);
+  CHECK(d[0].uring == NULL && d[1].uring == NULL);
+  CHECK(uring_attach(&d[0], "/dev/null") == -1);
+  fake_complete_all(0);
+  uring_reap(dsks, 0, done);
+  CHECK(cmd->pending == 1 && cmd2->pending == 1);
+  free(cmd);
+  free(cmd2);
+
+  if(!failed)
+    printf("uringtest: ok\n");
+  return failed;
+}
+
+#else
+
+int main(void) {
+  /* skipped */
+  return 77;
+}
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Hashed timer wheel.  Each slot covers WHEEL_TICK milliseconds; timers
+ * further away than one revolution simply stay in their slot until the
+ * wheel comes round to them again.  Adding or removing a timer is O(1)
+ * and expiring timers only visits the slots that elapsed.
+ */
+
+// Include file generated by ./configure
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+// Standard includes
+#include <time.h>
+
+// Application specific includes
+#include "wheel.h"
+
+#define WHEEL_TICK             100
+#define WHEEL_SLOTS            1024
+
+static struct timer  wheel[WHEEL_SLOTS];
+static long          wheel_tick;
+
+void wheel_init(void) {
+  int i;
+
+  for(i = 0; i < WHEEL_SLOTS; i++)
+    wheel[i].prev = wheel[i].next = &wheel[i];
+
+  wheel_tick = wheel_now() / WHEEL_TICK;
+}
+
+long wheel_now(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void wheel_add(struct timer *t, long expires) {
+  struct timer *slot;
+  long          tick;
+
+  wheel_del(t);
+
+  /* timers already due go in the current slot or they would wait for a
+     whole revolution */
+  tick = expires / WHEEL_TICK;
+  if(tick < wheel_tick)
+    tick = wheel_tick;
+
+  slot = &wheel[tick % WHEEL_SLOTS];
+  t->expires = expires;
+  t->prev = slot->prev;
+  t->next = slot;
+  slot->prev->next = t;
+  slot->prev = t;
+}
+
+void wheel_del(struct timer *t) {
+  if(t->next == NULL || t->next == t)
+    return;
+
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->prev = t->next = t;
+}
+
+/* Remove and return one timer due at "now", or NULL when there is none
+   left. */
+struct timer *wheel_expired(long now) {
+  struct timer *slot, *t;
+  long          tick;
+  int           n;
+
+  tick = now / WHEEL_TICK;
+
+  for(n = 0; n < WHEEL_SLOTS; n++) {
+    slot = &wheel[wheel_tick % WHEEL_SLOTS];
+
+    for(t = slot->next; t != slot; t = t->next) {
+      if(t->expires <= now) {
+        wheel_del(t);
+        return t;
+      }
+    }
+
+    if(wheel_tick >= tick)
+      return NULL;
+    wheel_tick++;
+  }
+
+  /* a full revolution was scanned: nothing else can be due */
+  wheel_tick = tick;
+  return NULL;
+}
+
+/* Expiry time of the earliest timer, or -1 if none is armed. */
+long wheel_next(void) {
+  struct timer *slot, *t;
+  long          best = -1;
+  int           n;
+
+  for(n = 0; n < WHEEL_SLOTS; n++) {
+    slot = &wheel[(wheel_tick + n) % WHEEL_SLOTS];
+
+    for(t = slot->next; t != slot; t = t->next) {
+      if(best == -1 || t->expires < best)
+        best = t->expires;
+    }
+
+    /* slots are visited in time order, so a timer falling within this
+       revolution cannot be beaten by a later slot */
+    if(best != -1 && best / WHEEL_TICK <= wheel_tick + n)
+      return best;
+  }
+
+  return best;
+}
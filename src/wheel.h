@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2026  hddtemp developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __WHEEL_H__
+#define __WHEEL_H__
+
+/* Timers are embedded in the object they schedule and expire at an
+   absolute CLOCK_MONOTONIC time given in milliseconds. */
+struct timer {
+  struct timer *  prev;
+  struct timer *  next;
+  long            expires;
+  void *          data;
+};
+
+void wheel_init(void);
+long wheel_now(void);
+void wheel_add(struct timer *t, long expires);
+void wheel_del(struct timer *t);
+struct timer *wheel_expired(long now);
+long wheel_next(void);
+
+#endif